@@ -0,0 +1,182 @@
+//
+//  ZEPTO-8 — Fantasy console emulator
+//
+//  Copyright © 2016—2021 Sam Hocevar <sam@hocevar.net>
+//
+//  This program is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#if HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <lol/msg>    // lol::msg
+#include <lol/utils>  // lol::ends_with
+#include <lol/thread> // lol::timer
+#include <algorithm>  // std::sort, std::min, std::max
+#include <deque>      // std::deque
+#include <filesystem> // std::filesystem
+#include <memory>     // std::unique_ptr
+#include <mutex>      // std::mutex
+#include <optional>   // std::optional
+#include <thread>     // std::thread
+
+#include "zepto8.h"
+#include "batch.h"
+#include "pico8/vm.h"
+#include "raccoon/vm.h"
+
+namespace z8
+{
+
+static bool is_cart(std::string const &name)
+{
+    return lol::ends_with(name, ".p8") || lol::ends_with(name, ".p8.png")
+        || lol::ends_with(name, ".rcn.json");
+}
+
+void batch::add(std::string const &path)
+{
+    std::error_code ec;
+    if (!std::filesystem::is_directory(path, ec))
+    {
+        m_jobs.push_back(job { path });
+        return;
+    }
+
+    // Sort directory entries so that the report order is stable
+    std::vector<std::string> carts;
+    for (auto const &entry : std::filesystem::directory_iterator(path, ec))
+        if (entry.is_regular_file() && is_cart(entry.path().filename().string()))
+            carts.push_back(entry.path().string());
+    std::sort(carts.begin(), carts.end());
+
+    for (auto const &cart : carts)
+        m_jobs.push_back(job { cart });
+}
+
+bool batch::run(int frames, int jobs)
+{
+    if (m_jobs.empty())
+    {
+        lol::msg::error("no carts to run\n");
+        return false;
+    }
+
+    if (jobs <= 0)
+        jobs = std::max(1, int(std::thread::hardware_concurrency()));
+    jobs = std::min(jobs, int(m_jobs.size()));
+
+    // Each worker owns a queue of job indices. Carts are dealt round-robin,
+    // and a worker that runs out of work steals from the back of the other
+    // queues, so that a few slow carts do not leave cores idle.
+    struct queue
+    {
+        std::mutex mutex;
+        std::deque<size_t> jobs;
+    };
+
+    std::vector<queue> queues(jobs);
+    for (size_t n = 0; n < m_jobs.size(); ++n)
+        queues[n % jobs].jobs.push_back(n);
+
+    auto next_job = [&](int id) -> std::optional<size_t>
+    {
+        {
+            std::lock_guard<std::mutex> lock(queues[id].mutex);
+            if (!queues[id].jobs.empty())
+            {
+                size_t n = queues[id].jobs.front();
+                queues[id].jobs.pop_front();
+                return n;
+            }
+        }
+
+        for (int k = 1; k < jobs; ++k)
+        {
+            auto &victim = queues[(id + k) % jobs];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs.empty())
+            {
+                size_t n = victim.jobs.back();
+                victim.jobs.pop_back();
+                return n;
+            }
+        }
+
+        return std::nullopt;
+    };
+
+    auto worker = [&](int id)
+    {
+        while (auto n = next_job(id))
+        {
+            auto &j = m_jobs[*n];
+            lol::timer t;
+
+            std::unique_ptr<vm_base> vm;
+            if (lol::ends_with(j.cart, ".rcn.json"))
+                vm.reset((vm_base *)new raccoon::vm());
+            else
+                vm.reset((vm_base *)new pico8::vm());
+            j.loaded = vm->load(j.cart);
+            if (j.loaded)
+                vm->run();
+
+            // Only count frames after which the cart is still running
+            while (j.loaded && j.frames < frames)
+            {
+                bool running = vm->step(1.f / 60.f);
+                j.gc_seconds += vm->get_gc_time();
+                j.max_cpu = std::max(j.max_cpu, vm->get_cpu_usage());
+                if (!running)
+                    break;
+                ++j.frames;
+            }
+
+            vm.reset();
+            j.seconds = t.get();
+        }
+    };
+
+    lol::timer t;
+    std::vector<std::thread> threads;
+    for (int id = 0; id < jobs; ++id)
+        threads.emplace_back(worker, id);
+    for (auto &th : threads)
+        th.join();
+    float seconds = t.get();
+
+    // Carts that failed to load are reported but left out of the totals
+    int total_carts = 0, total_frames = 0;
+    for (auto const &j : m_jobs)
+    {
+        if (!j.loaded)
+        {
+            printf("%10s %7s frames %9s gc %7s cpu  %s (failed to load)\n",
+                   "-", "-", "-", "-", j.cart.c_str());
+            continue;
+        }
+
+        printf("%9.3fs %7d frames %8.3fs gc %6.0f%% cpu  %s\n", j.seconds,
+               j.frames, j.gc_seconds, j.max_cpu * 100.f, j.cart.c_str());
+        ++total_carts;
+        total_frames += j.frames;
+    }
+
+    printf("\n%d carts, %d frames in %.3fs on %d threads: %.1f frames/s\n",
+           total_carts, total_frames, seconds, jobs,
+           seconds > 0.f ? total_frames / seconds : 0.f);
+    if (total_carts < int(m_jobs.size()))
+        printf("%d carts failed to load\n", int(m_jobs.size()) - total_carts);
+    fflush(stdout);
+
+    return total_carts == int(m_jobs.size());
+}
+
+} // namespace z8
+
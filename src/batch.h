@@ -0,0 +1,52 @@
+//
+//  ZEPTO-8 — Fantasy console emulator
+//
+//  Copyright © 2016—2021 Sam Hocevar <sam@hocevar.net>
+//
+//  This program is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#pragma once
+
+#include <string> // std::string
+#include <vector> // std::vector
+
+// The batch runner
+// ————————————————
+// Runs many carts headless, each worker thread owning its own VM, and
+// reports per-cart wall time and aggregate throughput.
+
+namespace z8
+{
+
+class batch
+{
+public:
+    // Add a cart, or all the carts found in a directory
+    void add(std::string const &path);
+
+    // Step every cart for the given number of frames, using the given
+    // number of worker threads (0 means one per hardware thread). Return
+    // false if any of the carts failed to load.
+    bool run(int frames, int jobs);
+
+private:
+    struct job
+    {
+        std::string cart;
+        int frames = 0;
+        float seconds = 0.f;
+        float gc_seconds = 0.f;
+        float max_cpu = 0.f;
+        bool loaded = false;
+    };
+
+    std::vector<job> m_jobs;
+};
+
+} // namespace z8
+
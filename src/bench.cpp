@@ -0,0 +1,429 @@
+//
+//  ZEPTO-8 — Fantasy console emulator
+//
+//  Copyright © 2016—2021 Sam Hocevar <sam@hocevar.net>
+//
+//  This program is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#if HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <lol/file>   // lol::file
+#include <lol/msg>    // lol::msg
+#include <lol/thread> // lol::timer
+#include <lol/utils>  // lol::format, lol::split
+#include <cstdlib>    // std::abs
+#include <filesystem> // std::filesystem
+#include <iterator>   // std::size
+#include <map>        // std::map
+#include <memory>     // std::unique_ptr
+#include <random>     // std::random_device
+
+#include "zepto8.h"
+#include "bench.h"
+#include "pico8/vm.h"
+
+namespace z8::bench
+{
+
+// Run a function repeatedly for about one second and return the number
+// of calls per second
+template<typename T> static float measure(T fn)
+{
+    lol::timer t;
+    int count = 0;
+    float seconds = 0.f;
+    do
+    {
+        for (int i = 0; i < 16; ++i)
+            fn();
+        count += 16;
+        seconds += t.get();
+    }
+    while (seconds < 1.f);
+
+    return count / seconds;
+}
+
+bool dispatch()
+{
+    // Each frame calls an API function a fixed number of times; keep it
+    // low enough for the frame to never be interrupted by the CPU model.
+    int const calls = 10000;
+    static char const *tests[] =
+    {
+        "peek(0)", "pset(0,0,0)", "rnd()", "band(1,1)",
+    };
+
+    auto filename = (std::filesystem::temp_directory_path() / "z8bench.lua").string();
+
+    for (auto const *test : tests)
+    {
+        std::string code = lol::format("function _update60() for i=1,%d do %s end end\n",
+                                       calls, test);
+        if (!lol::file::write(filename, code))
+            return false;
+
+        pico8::vm vm;
+        if (!vm.load(filename))
+        {
+            lol::msg::error("cannot load %s\n", filename.c_str());
+            return false;
+        }
+        vm.run();
+        vm.step(1.f / 60.f);
+
+        float frames = measure([&]() { vm.step(0.f); });
+        printf("%12.1f calls/s  %s\n", frames * calls, test);
+    }
+
+    std::filesystem::remove(filename);
+    fflush(stdout);
+    return true;
+}
+
+bool clone(std::string const &cart, int frames)
+{
+    pico8::vm vm;
+    if (!vm.load(cart))
+    {
+        lol::msg::error("cannot load %s\n", cart.c_str());
+        return false;
+    }
+    vm.run();
+    for (int i = 0; i < frames; ++i)
+        vm.step(1.f / 60.f);
+
+    pico8::snapshot s;
+    if (!vm.save(s))
+        return false;
+
+    printf("snapshot: %d bytes of Lua state\n", int(s.lua.size()));
+
+    float saves = measure([&]() { vm.save(s); });
+    printf("%12.1f snapshots/s\n", saves);
+
+    float restores = measure([&]() { vm.restore(s); });
+    printf("%12.1f restores/s\n", restores);
+
+    float clones = measure([&]() { std::unique_ptr<vm_base> copy = vm.clone(); });
+    printf("%12.1f clones/s\n", clones);
+    fflush(stdout);
+
+    return true;
+}
+
+// FNV-1a hash of the screen memory
+static uint64_t screen_hash(pico8::vm &vm)
+{
+    auto [ram, size] = vm.ram();
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0x6000; i < 0x8000 && i < size; ++i)
+        hash = (hash ^ ram[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+// A small deterministic generator for the graphics sweeps. Arguments are
+// written to the generated cart as literals, so that the golden hashes do
+// not depend on the rnd() implementation or on Lua arithmetic.
+class sweep_rng
+{
+public:
+    sweep_rng(uint32_t seed) : m_state(seed) {}
+
+    // Uniform integer in [lo, hi]
+    int operator()(int lo, int hi)
+    {
+        m_state = m_state * 1664525u + 1013904223u;
+        return lo + int((m_state >> 8) % uint32_t(hi - lo + 1));
+    }
+
+    std::string num(int lo, int hi)
+    {
+        return std::to_string((*this)(lo, hi));
+    }
+
+    std::string flag()
+    {
+        return (*this)(0, 1) ? "true" : "false";
+    }
+
+    // Number in [lo, hi] with a random 16-bit fractional part, as an exact
+    // hexadecimal literal
+    std::string fix(int lo, int hi)
+    {
+        int bits = (*this)(lo * 0x10000, hi * 0x10000);
+        return lol::format("%s0x%x.%04x", bits < 0 ? "-" : "",
+                           std::abs(bits) >> 16, std::abs(bits) & 0xffff);
+    }
+
+    // Printable string of up to 12 characters, glyphs 0x80+ included
+    std::string str()
+    {
+        std::string ret = "\"";
+        for (int i = (*this)(0, 12); i > 0; --i)
+            ret += lol::format("\\%d", (*this)(0x20, 0xff));
+        return ret + "\"";
+    }
+
+    // Fill pattern with the top bit clear, so that the literal stays
+    // positive, and a random transparency bit
+    std::string pattern()
+    {
+        int bits = (*this)(0, 0x7fff);
+        return lol::format("0x%x.%d", bits, (*this)(0, 1) * 8);
+    }
+
+    // Start of a span of the given size that lies just off, touching or
+    // across either end of [0, extent), or in its middle
+    int span(int size, int extent)
+    {
+        int const starts[] =
+        {
+            -size - 1, -size, -size + 1, -size / 2, 0, 1, (extent - size) / 2,
+            extent - size - 2, extent - size - 1, extent - size,
+            extent - size / 2 - 1, extent - 1, extent,
+        };
+        return starts[(*this)(0, int(std::size(starts)) - 1)];
+    }
+
+    // The elements of an initialiser list are evaluated in order, unlike
+    // function arguments, so the sweeps below are the same everywhere
+    static std::string join(std::initializer_list<std::string> list)
+    {
+        std::string ret;
+        for (auto const &s : list)
+            ret += (ret.empty() ? "" : ",") + s;
+        return ret;
+    }
+
+private:
+    uint32_t m_state;
+};
+
+bool gfx(std::string const &golden, bool update, float min_mpixels, float min_speedup)
+{
+    // Each sweep fills the sprite sheet, map and sprite flags with random
+    // data, then draws the same list of calls every frame. The pset() sweep
+    // comes first: it measures the per-call overhead, and the others are
+    // expected to draw many more pixels per second than it does.
+    int const calls = 1000;
+    static char const *code =
+        "function _init()\n"
+        "  draw = %s\n"
+        "  args = {\n%s  }\n"
+        "end\n"
+        "function _update60()\n"
+        "  cls() fillp()\n"
+        "  for i=1,#args do draw(unpack(args[i])) end\n"
+        "end\n";
+
+    using args_fn = std::string (*)(sweep_rng &, int);
+    static struct { char const *name, *draw; args_fn args; bool timed = true; } const sweeps[] =
+    {
+        { "pset", "pset", [](sweep_rng &r, int)
+          {
+              return r.join({ r.num(-8, 135), r.num(-8, 135), r.num(0, 15) });
+          } },
+        { "spr", "spr", [](sweep_rng &r, int)
+          {
+              return r.join({ r.num(0, 255), r.num(-16, 143), r.num(-16, 143),
+                              r.fix(0, 3), r.fix(0, 3), r.flag(), r.flag() });
+          } },
+        { "sspr", "sspr", [](sweep_rng &r, int)
+          {
+              return r.join({ r.num(0, 127), r.num(0, 127), r.num(0, 48), r.num(0, 48),
+                              r.num(-16, 143), r.num(-16, 143), r.num(-8, 96),
+                              r.num(-8, 96), r.flag(), r.flag() });
+          } },
+        { "map", "map", [](sweep_rng &r, int)
+          {
+              return r.join({ r.num(0, 127), r.num(0, 63), r.num(-32, 159),
+                              r.num(-32, 159), r.num(0, 16), r.num(0, 16),
+                              r.num(0, 255) });
+          } },
+        { "tline", "tline", [](sweep_rng &r, int)
+          {
+              return r.join({ r.num(-32, 159), r.num(-32, 159), r.num(-32, 159),
+                              r.num(-32, 159), r.fix(0, 127), r.fix(0, 63),
+                              r.fix(-1, 0), r.fix(0, 1) });
+          } },
+        { "line", "line", [](sweep_rng &r, int)
+          {
+              return r.join({ r.num(-64, 191), r.num(-64, 191), r.num(-64, 191),
+                              r.num(-64, 191), r.num(0, 15) });
+          } },
+        { "circ", "function(x, y, r, c, f) "
+                  "if f then circfill(x, y, r, c) else circ(x, y, r, c) end end",
+          [](sweep_rng &r, int)
+          {
+              return r.join({ r.num(-16, 143), r.num(-16, 143), r.num(0, 48),
+                              r.num(0, 15), r.flag() });
+          } },
+        { "oval", "function(x0, y0, x1, y1, c, f) "
+                  "if f then ovalfill(x0, y0, x1, y1, c) else oval(x0, y0, x1, y1, c) end end",
+          [](sweep_rng &r, int)
+          {
+              return r.join({ r.num(-32, 159), r.num(-32, 159), r.num(-32, 159),
+                              r.num(-32, 159), r.num(0, 15), r.flag() });
+          } },
+        { "rectfill", "function(x0, y0, x1, y1, c, f) "
+                      "if f then rectfill(x0, y0, x1, y1, c) else rect(x0, y0, x1, y1, c) end end",
+          [](sweep_rng &r, int)
+          {
+              return r.join({ r.num(-32, 159), r.num(-32, 159), r.num(-32, 159),
+                              r.num(-32, 159), r.num(0, 15), r.flag() });
+          } },
+        { "print", "print", [](sweep_rng &r, int)
+          {
+              return r.join({ r.str(), r.num(-16, 143), r.num(-16, 143), r.num(0, 15) });
+          } },
+        { "fillp", "function(p, x0, y0, x1, y1, c) fillp(p) rectfill(x0, y0, x1, y1, c) "
+                   "circfill(x1, y0, (y1 - y0) / 4, c) line(x0, y1, x1, y0, c) end",
+          [](sweep_rng &r, int)
+          {
+              return r.join({ r.pattern(), r.num(-32, 159), r.num(-32, 159),
+                              r.num(-32, 159), r.num(-32, 159), r.num(0, 255) });
+          } },
+        // Every radius or width from 0 to 63, then a few large ones, just
+        // off, touching or across the edges of a clipping rectangle. Each
+        // call gets an 8×8 cell so that later calls do not hide its edges;
+        // these sweeps mostly measure clip() calls, so they are not timed.
+        { "circ-edges", "function(cx, cy, x, y, r, c, f) clip(cx, cy, 8, 8) "
+                        "if f then circfill(x, y, r, c) else circ(x, y, r, c) end end",
+          [](sweep_rng &r, int i)
+          {
+              int cell = i / 4 % 256, cx = cell % 16 * 8, cy = cell / 16 * 8;
+              int radius = i < 960 ? i % 64 : r(64, 512);
+              return r.join({ std::to_string(cx), std::to_string(cy),
+                              std::to_string(cx + r.span(2 * radius, 8) + radius),
+                              std::to_string(cy + r.span(2 * radius, 8) + radius),
+                              std::to_string(radius), r.num(0, 15), r.flag() });
+          }, false },
+        { "oval-edges", "function(cx, cy, x0, y0, x1, y1, c, f) clip(cx, cy, 8, 8) "
+                        "if f then ovalfill(x0, y0, x1, y1, c) else oval(x0, y0, x1, y1, c) end end",
+          [](sweep_rng &r, int i)
+          {
+              int cell = i / 4 % 256, cx = cell % 16 * 8, cy = cell / 16 * 8;
+              int w = i < 960 ? i % 64 : r(64, 512), h = r(0, 63);
+              int x0 = cx + r.span(w, 8), y0 = cy + r.span(h, 8);
+              // Also pass the corners in reverse order
+              if (r(0, 1))
+              {
+                  x0 += w;
+                  w = -w;
+              }
+              return r.join({ std::to_string(cx), std::to_string(cy),
+                              std::to_string(x0), std::to_string(y0),
+                              std::to_string(x0 + w), std::to_string(y0 + h),
+                              r.num(0, 15), r.flag() });
+          }, false },
+    };
+
+    // The golden file has one “<sweep> <hash>” line per sweep
+    std::map<std::string, std::string> hashes;
+    std::string data;
+    if (lol::file::read(golden, data))
+    {
+        for (auto const &line : lol::split(data, '\n'))
+        {
+            auto sep = line.find(' ');
+            if (line.empty() || line[0] == '#' || sep == std::string::npos)
+                continue;
+            hashes[line.substr(0, sep)] = line.substr(sep + 1);
+        }
+    }
+
+    // Use a unique name so that concurrent runs do not share the file
+    auto filename = (std::filesystem::temp_directory_path()
+                      / lol::format("z8gfx-%08x.lua", std::random_device()())).string();
+    float pset_mpixels = 0.f;
+    bool ret = true;
+
+    for (auto const &s : sweeps)
+    {
+        uint32_t seed = uint32_t(&s - sweeps) + 1;
+        sweep_rng r(seed);
+        std::string args;
+        for (int i = 0; i < calls; ++i)
+            args += "    { " + s.args(r, i) + " },\n";
+        if (!lol::file::write(filename, lol::format(code, s.draw, args.c_str())))
+            return false;
+
+        // Never interrupt a frame, whatever the number of pixels drawn
+        pico8::vm vm;
+        if (!vm.load(filename))
+        {
+            printf("%10s Mpixels/s %7s  %16s  %-10s  %s\n", "-", "-", "-", s.name,
+                   "LOAD FAILED");
+            ret = false;
+            continue;
+        }
+        vm.set_cpu_budget(1000.f);
+        vm.run();
+        vm.step(1.f / 60.f);
+
+        // Memory is reset when the cart starts, so fill it afterwards
+        auto [ram, size] = vm.ram();
+        for (size_t i = 0; i < 0x3100 && i < size; ++i)
+            ram[i] = uint8_t(r(0, 255));
+
+        // Do not count the pixels cleared by cls()
+        float frames = measure([&]() { vm.step(0.f); });
+        float mpixels = frames * float(vm.get_cost().pixels - 128 * 128) / 1e6f;
+        auto hash = lol::format("%016llx", (unsigned long long)screen_hash(vm));
+        if (&s == sweeps)
+            pset_mpixels = mpixels;
+
+        char const *status = "ok";
+        auto it = hashes.find(s.name);
+        if (update && (it == hashes.end() || it->second != hash))
+        {
+            status = it == hashes.end() ? "added" : "updated";
+            hashes[s.name] = hash;
+        }
+        else if (it == hashes.end())
+        {
+            status = "MISSING";
+            ret = false;
+        }
+        else if (it->second != hash)
+        {
+            status = "MISMATCH";
+            ret = false;
+        }
+
+        if (s.timed && (mpixels < min_mpixels
+                        || (&s != sweeps && mpixels < min_speedup * pset_mpixels)))
+        {
+            status = "TOO SLOW";
+            ret = false;
+        }
+
+        printf("%10.2f Mpixels/s %6.1fx  %s  %-10s  %s\n", mpixels,
+               pset_mpixels > 0.f ? mpixels / pset_mpixels : 0.f,
+               hash.c_str(), s.name, status);
+    }
+
+    std::filesystem::remove(filename);
+    fflush(stdout);
+
+    if (update)
+    {
+        std::string out = "# Screen hashes for “z8tool bench --gfx”, see doc/z8tool.md\n";
+        for (auto const &[name, hash] : hashes)
+            out += name + " " + hash + "\n";
+        if (!lol::file::write(golden, out))
+            return false;
+    }
+
+    return ret;
+}
+
+} // namespace z8::bench
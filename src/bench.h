@@ -0,0 +1,39 @@
+//
+//  ZEPTO-8 — Fantasy console emulator
+//
+//  Copyright © 2016—2021 Sam Hocevar <sam@hocevar.net>
+//
+//  This program is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#pragma once
+
+#include <string> // std::string
+
+// The benchmarks
+// ——————————————
+// Small timing loops over the VM internals, used by “z8tool bench”.
+
+namespace z8::bench
+{
+
+// Measure how many API calls per second Lua code can perform
+bool dispatch();
+
+// Warm up a cart for the given number of frames, then measure how many
+// times per second the VM can be cloned, and snapshotted then restored.
+bool clone(std::string const &cart, int frames);
+
+// Draw seeded random sweeps of each graphics primitive, report how many
+// pixels per second they draw, and compare the resulting screens with the
+// hashes stored in the golden file. Missing or different hashes are stored
+// if update is true, and are errors otherwise. Also fail if a primitive is
+// slower than min_mpixels, or than min_speedup times pset().
+bool gfx(std::string const &golden, bool update, float min_mpixels,
+         float min_speedup);
+
+} // namespace z8::bench
@@ -14,6 +14,7 @@
 #   include "config.h"
 #endif
 
+#include <algorithm> // std::max
 #include <optional>
 #include <variant>
 
@@ -21,6 +22,8 @@
 #include "3rdparty/z8lua/lauxlib.h"
 #include "3rdparty/z8lua/lualib.h"
 
+#include "bindings/stack.h"
+
 namespace z8::bindings
 {
 
@@ -64,6 +67,12 @@ template<typename... T> int lua_push(lua_State *l, std::vector<T...> const &v)
     return (int)v.size();
 }
 
+// A stack writer has already pushed its values; just report how many
+template<typename T> int lua_push(lua_State *, stack_writer<T> const &w)
+{
+    return w.count;
+}
+
 //
 // Get a standard type from the Lua stack
 //
@@ -91,6 +100,14 @@ template<typename T> void lua_get(lua_State *l, int i, std::vector<T> &arg)
         arg.push_back(lua_get<T>(l, i++));
 }
 
+// Unboxing to a stack view references the rest of the stack in place
+template<typename T> void lua_get(lua_State *l, int i, stack_view<T> &arg)
+{
+    arg.l = l;
+    arg.first = i;
+    arg.count = std::max(0, lua_gettop(l) - i + 1);
+}
+
 template<typename T> static T lua_get(lua_State *l, int i)
 {
     T ret; lua_get(l, i, ret); return ret;
@@ -106,19 +123,15 @@ public:
     template<typename T>
     static void init(lua_State *l, T *that)
     {
-        // Store a pointer to the caller in the global state
-#if HAVE_LUA_GETEXTRASPACE
-        *static_cast<vm**>(lua_getextraspace(l)) = that;
-#else
-        lua_pushlightuserdata(l, that);
-        lua_setglobal(l, "\x01");
-#endif
-
         auto lib = typename T::template exported_api<lua>().data;
         lib.push_back({});
 
+        // Register all functions as C closures sharing a pointer to the
+        // caller as their only upvalue
         lua_pushglobaltable(l);
-        luaL_setfuncs(l, lib.data(), 0);
+        lua_pushlightuserdata(l, that);
+        luaL_setfuncs(l, lib.data(), 1);
+        lua_pop(l, 1);
     }
 
     // Helper to dispatch C++ functions to Lua C bindings
@@ -126,7 +139,7 @@ public:
     {
         static int wrap(lua_State *l)
         {
-            return dispatch(l, FN, make_seq(FN));
+            return dispatch(l, FN, make_seq(FN), &wrap);
         }
 
         // Create an index sequence from a member function’s signature
@@ -154,26 +167,43 @@ private:
     // and push the result to the Lua stack.
     template<typename T, typename R, typename... A, size_t... IS>
     static inline int dispatch(lua_State *l, R (T::*f)(A...),
-                               std::index_sequence<IS...>)
+                               std::index_sequence<IS...>, lua_CFunction self)
     {
-        // Retrieve “this” from the Lua state.
-    #if HAVE_LUA_GETEXTRASPACE
-        T *that = *static_cast<T**>(lua_getextraspace(l));
-    #else
-        lua_getglobal(l, "\x01");
-        T *that = (T *)lua_touserdata(l, -1);
-        lua_remove(l, -1);
-    #endif
+        // Retrieve “this” from the closure upvalue
+        T *that = (T *)lua_touserdata(l, lua_upvalueindex(1));
 
         // Store this for API functions that we don’t know yet how to wrap
         that->m_sandbox_lua = l;
 
         // Call the API function with the loaded arguments. Some specialization
-        // is needed when the wrapped function returns void.
-        if constexpr (std::is_same<R, void>::value)
-            return (that->*f)(lua_get<A>(l, IS + 1)...), 0;
-        else
-            return lua_push(l, (that->*f)(lua_get<A>(l, IS + 1)...));
+        // is needed when the wrapped function returns void, and functions that
+        // take the Lua state directly manage the stack themselves.
+        auto call = [&]() -> int
+        {
+            if constexpr (std::is_same<R(A...), int(lua_State *)>::value)
+                return (that->*f)(l);
+            else if constexpr (std::is_same<R, void>::value)
+                return (that->*f)(lua_get<A>(l, IS + 1)...), 0;
+            else
+                return lua_push(l, (that->*f)(lua_get<A>(l, IS + 1)...));
+        };
+
+        // Time the native call when the profiler is active
+        auto *profiler = that->get_profiler();
+        if (!profiler)
+            return call();
+
+        // Lua errors are C++ exceptions since z8lua is built as C++, so
+        // this also leaves the profiler when an error unwinds the call.
+        struct guard
+        {
+            decltype(profiler) p;
+            ~guard() { p->leave(); }
+        };
+
+        profiler->enter(self);
+        guard g { profiler };
+        return call();
     }
 };
 
@@ -0,0 +1,56 @@
+//
+//  ZEPTO-8 — Fantasy console emulator
+//
+//  Copyright © 2016—2021 Sam Hocevar <sam@hocevar.net>
+//
+//  This program is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#pragma once
+
+#include "3rdparty/z8lua/lua.h"
+#include "3rdparty/z8lua/lauxlib.h"
+
+// Lua stack views
+// ———————————————
+// Argument and return types for API functions that take or return a
+// variable number of values. Unlike std::vector, they work in place on
+// the Lua stack and never allocate.
+
+namespace z8::bindings
+{
+
+// Variadic numeric arguments, read directly from the Lua stack starting
+// at the argument’s position. Nothing is copied until an element is read.
+template<typename T> struct stack_view
+{
+    lua_State *l = nullptr;
+    int first = 0, count = 0;
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return (size_t)count; }
+    T operator[](int n) const { return (T)lua_tonumber(l, first + n); }
+};
+
+// Variadic numeric return values, pushed directly to the Lua stack by
+// the API function instead of being collected in a container first.
+template<typename T> struct stack_writer
+{
+    stack_writer(lua_State *state, int reserve)
+      : l(state)
+    {
+        luaL_checkstack(l, reserve, "too many results");
+    }
+
+    void push(T x) { lua_pushnumber(l, (lua_Number)x); ++count; }
+
+    lua_State *l;
+    int count = 0;
+};
+
+} // namespace z8::bindings
+
@@ -17,18 +17,74 @@
 #include <lol/msg> // lol::msg
 
 #include "bios.h"
+#include "pico8/cart.h"
+
+#include "3rdparty/z8lua/lua.h"
+#include "3rdparty/z8lua/lauxlib.h"
 
 namespace z8::pico8
 {
 
+// The contents of pico8/bios.p8, generated at build time
+static uint8_t const bios_p8[] =
+{
+#include "pico8/bios.inc"
+};
+
+bios const &bios::get()
+{
+    // Initialised on first use; thread safe since C++11
+    static bios const instance;
+    return instance;
+}
+
 bios::bios()
 {
-    char const *filename = "pico8/bios.p8";
+    cart c;
+    if (!c.load_p8_data(std::string((char const *)bios_p8, sizeof(bios_p8))))
+        lol::msg::error("unable to parse embedded BIOS\n");
+
+    // Decode the font once; it never changes
+    for (int y = 0; y < 128; ++y)
+        for (int x = 0; x < 128; ++x)
+            m_gfx[y * 128 + x] = c.get_rom().gfx.get(x, y);
+
+    // Glyphs are 4×5 in 4×6 cells, or 8×5 for characters 0x80 and above
+    for (int ch = 0; ch < 256; ++ch)
+    {
+        int w = ch < 0x80 ? 4 : 8;
+        int offset = ch < 0x80 ? ch : 2 * ch - 0x80;
+        int font_x = offset % 32 * 4;
+        int font_y = offset / 32 * 6;
 
-    // Initialize BIOS
-    if (!m_cart.load(filename))
-        lol::msg::error("unable to load BIOS file %s\n", filename);
+        for (int dy = 0; dy < 5; ++dy)
+        {
+            uint8_t bits = 0;
+            for (int dx = 0; dx < w; ++dx)
+                bits |= (get_spixel(font_x + dx, font_y + dy) ? 1 : 0) << dx;
+            m_glyphs[ch][dy] = bits;
+        }
+    }
+
+    // Compile the BIOS code in a scratch Lua state and keep the bytecode,
+    // so that each VM only needs to load and run it.
+    lua_State *l = luaL_newstate();
+    std::string const &code = c.get_code();
+    int status = luaL_loadbuffer(l, code.c_str(), code.length(), "bios.p8");
+    if (status == LUA_OK)
+    {
+        lua_dump(l, [](lua_State *, void const *p, size_t sz, void *ud)
+        {
+            ((std::string *)ud)->append((char const *)p, sz);
+            return 0;
+        }, &m_bytecode);
+    }
+    else
+    {
+        lol::msg::error("error %d compiling bios.p8: %s\n", status,
+                        lua_tostring(l, -1));
+    }
+    lua_close(l);
 }
 
 } // namespace z8
-
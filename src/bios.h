@@ -12,12 +12,15 @@
 
 #pragma once
 
-#include "pico8/cart.h"
+#include <array>  // std::array
+#include <string> // std::string
 
 // The bios class
 // ——————————————
-// The actual ZEPTO-8 BIOS: contains the font and the startup code, loaded
-// from a regular .p8 cartridge file.
+// The actual ZEPTO-8 BIOS: contains the font and the startup code. The
+// .p8 cartridge is embedded in the binary at build time, then decoded
+// and compiled to Lua bytecode once per process; all VMs share the
+// resulting read-only instance.
 
 namespace z8::pico8
 {
@@ -25,11 +28,12 @@ namespace z8::pico8
 class bios
 {
 public:
-    bios();
+    static bios const &get();
 
-    std::string const &get_code() const
+    // Precompiled Lua bytecode for the BIOS code
+    std::string const &get_bytecode() const
     {
-        return m_cart.get_code();
+        return m_bytecode;
     }
 
     uint8_t get_spixel(int16_t x, int16_t y) const
@@ -37,12 +41,22 @@ public:
         if (x < 0 || x >= 128 || y < 0 || y >= 128)
             return 0;
 
-        return m_cart.get_rom().gfx.get(x, y);
+        return m_gfx[y * 128 + x];
+    }
+
+    // The five rows of a default font glyph, as bitmasks where bit n is
+    // set if column n of that row is drawn
+    uint8_t const *get_glyph(uint8_t ch) const
+    {
+        return m_glyphs[ch].data();
     }
 
 private:
-    cart m_cart;
+    bios();
+
+    std::string m_bytecode;
+    std::array<uint8_t, 128 * 128> m_gfx;
+    std::array<std::array<uint8_t, 5>, 256> m_glyphs;
 };
 
 } // namespace z8
-
@@ -0,0 +1,159 @@
+//
+//  ZEPTO-8 — Fantasy console emulator
+//
+//  Copyright © 2016—2021 Sam Hocevar <sam@hocevar.net>
+//
+//  This program is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#if HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <algorithm> // std::min, std::max
+#include <cstdlib>   // std::malloc, std::realloc, std::free
+#include <cstring>   // std::memcpy
+
+#include "heap.h"
+
+namespace z8
+{
+
+heap::~heap()
+{
+    while (m_chunks)
+    {
+        void *next = *(void **)m_chunks;
+        std::free(m_chunks);
+        m_chunks = next;
+    }
+
+    while (m_adopted)
+    {
+        void *next = *(void **)m_adopted;
+        std::free((uint8_t *)m_adopted - max_small);
+        m_adopted = next;
+    }
+}
+
+// This is called from a lua_Alloc callback, so it must not throw; return
+// a null pointer if the system is out of memory.
+void *heap::alloc_small(size_t size)
+{
+    size_t n = size_class(size);
+    if (void *ret = m_free[n])
+    {
+        m_free[n] = *(void **)ret;
+        return ret;
+    }
+
+    size_t block = (n + 1) * granularity;
+    if (m_cur + block > m_end)
+    {
+        auto *chunk = (uint8_t *)std::malloc(chunk_size);
+        if (!chunk)
+            return nullptr;
+        *(void **)chunk = m_chunks;
+        m_chunks = chunk;
+        m_cur = chunk + granularity;
+        m_end = chunk + chunk_size;
+    }
+
+    void *ret = m_cur;
+    m_cur += block;
+    return ret;
+}
+
+void heap::free_small(void *ptr, size_t size)
+{
+    size_t n = size_class(size);
+    *(void **)ptr = m_free[n];
+    m_free[n] = ptr;
+}
+
+void heap::adopt(void *ptr)
+{
+    void **link = (void **)((uint8_t *)ptr + max_small);
+    *link = m_adopted;
+    m_adopted = link;
+}
+
+void *heap::alloc(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+    heap *that = (heap *)ud;
+
+    // When ptr is null, osize encodes the object type and is meaningless
+    if (!ptr)
+        osize = 0;
+
+    if (nsize == 0)
+    {
+        if (ptr)
+        {
+            if (osize <= max_small)
+                that->free_small(ptr, osize);
+            else
+                std::free(ptr);
+            that->m_used -= osize;
+        }
+        return nullptr;
+    }
+
+    // Lua expects shrinking to never fail, so only check the limit when
+    // the block grows; Lua will run a full GC and retry before giving up.
+    if (nsize > osize && that->m_used - osize + nsize > that->m_limit)
+        return nullptr;
+
+    void *ret;
+    if (nsize <= max_small)
+    {
+        // Blocks of the same size class can be reused as is
+        if (ptr && osize <= max_small && size_class(osize) == size_class(nsize))
+            ret = ptr;
+        else
+            ret = that->alloc_small(nsize);
+    }
+    else if (ptr && osize > max_small)
+    {
+        ret = std::realloc(ptr, std::max(nsize, min_large));
+        if (ret)
+            ptr = nullptr;
+    }
+    else
+    {
+        ret = std::malloc(std::max(nsize, min_large));
+    }
+
+    if (!ret)
+    {
+        // Shrinking must not fail: keep the old block, which is at least
+        // as large. If it came from the system and is now small, it will
+        // end up in a free list instead of being freed, so make sure the
+        // heap releases it eventually.
+        if (nsize > osize)
+            return nullptr;
+        if (osize > max_small && nsize <= max_small)
+            that->adopt(ptr);
+        that->m_used -= osize - nsize;
+        return ptr;
+    }
+
+    // Move the data if the block changed and release the old one
+    if (ptr && ret != ptr)
+    {
+        std::memcpy(ret, ptr, std::min(osize, nsize));
+        if (osize <= max_small)
+            that->free_small(ptr, osize);
+        else
+            std::free(ptr);
+    }
+
+    that->m_used += nsize - osize;
+    return ret;
+}
+
+} // namespace z8
@@ -0,0 +1,78 @@
+//
+//  ZEPTO-8 — Fantasy console emulator
+//
+//  Copyright © 2016—2021 Sam Hocevar <sam@hocevar.net>
+//
+//  This program is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#pragma once
+
+#include <array>   // std::array
+#include <cstddef> // size_t
+#include <cstdint> // SIZE_MAX
+
+// The heap class
+// ——————————————
+// A memory allocator for one Lua state. Small blocks come from per-size
+// free lists carved out of large chunks, large blocks from the system.
+// The heap keeps track of the number of live bytes, so that memory usage
+// can be queried without running the GC, and can refuse allocations above
+// a given limit.
+
+namespace z8
+{
+
+class heap
+{
+public:
+    heap() = default;
+    heap(heap const &) = delete;
+    ~heap();
+
+    // The lua_Alloc callback; ud must point to a heap object
+    static void *alloc(void *ud, void *ptr, size_t osize, size_t nsize);
+
+    // Number of bytes currently allocated by Lua
+    size_t used() const { return m_used; }
+
+    // Refuse allocations that would make used() grow above this limit
+    void set_limit(size_t limit) { m_limit = limit; }
+
+private:
+    static size_t constexpr granularity = 16;
+    static size_t constexpr max_small = 512;
+    static size_t constexpr chunk_size = 64 * 1024;
+
+    // Blocks from the system are never smaller than this, so that there
+    // is always room for a link after the largest small block.
+    static size_t constexpr min_large = max_small + sizeof(void *);
+
+    static size_t size_class(size_t size) { return (size - 1) / granularity; }
+
+    void *alloc_small(size_t size);
+    void free_small(void *ptr, size_t size);
+    void adopt(void *ptr);
+
+    size_t m_used = 0, m_limit = SIZE_MAX;
+
+    // Singly linked free lists, one per size class
+    std::array<void *, max_small / granularity> m_free {};
+
+    // Memory chunks that small blocks are carved from; the first bytes of
+    // each chunk link to the previous one, so that keeping track of them
+    // never needs to allocate.
+    void *m_chunks = nullptr;
+    uint8_t *m_cur = nullptr, *m_end = nullptr;
+
+    // Blocks from the system that were kept as small blocks because a
+    // shrink could not be honoured; they are linked through the bytes at
+    // offset max_small and freed with the heap.
+    void *m_adopted = nullptr;
+};
+
+} // namespace z8
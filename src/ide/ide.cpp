@@ -407,7 +407,13 @@ void ide::render_windows()
         ImGui::SetNextWindowPos(lol::ivec2(60, 480), ImGuiCond_FirstUseEver);
         ImGui::SetNextWindowSize(lol::ivec2(512, 246), ImGuiCond_FirstUseEver);
         if (ImGui::Begin("RAM", &m_show.ram))
+        {
             m_ram_editor->render();
+
+            // Tell the VM that memory may have been edited, see vm::ram()
+            if (m_vm)
+                m_ram_editor->attach(m_vm->ram());
+        }
         ImGui::End();
     }
 
@@ -52,9 +52,10 @@ std::unordered_set<std::string> api::functions =
     "clip", "cls", "color", "fillp", "fget", "fset", "line", "map", "mget",
     "mset", "oval", "ovalfill", "pal", "palt", "pget", "pset", "rect", "rectfill",
     "serial", "sget", "sset", "spr", "sspr", "music", "sfx", "time", "tline",
+    "count", "add", "all", "del", "deli",
     // Implemented in the ZEPTO-8 BIOS
     "cocreate", "coresume", "costatus", "yield", "trace", "stop",
-    "count", "add", "sub", "foreach", "all", "del", "deli", "t", "dget",
+    "sub", "foreach", "t", "dget",
     "dset", "cartdata", "load", "save", "info", "abort", "folder",
     "resume", "reboot", "dir", "ls", "flip", "mapdraw",
 };
@@ -374,6 +374,11 @@ bool cart::load_p8(std::string const &filename)
 
     msg::debug("loaded file %s\n", filename.c_str());
 
+    return load_p8_data(s);
+}
+
+bool cart::load_p8_data(std::string const &s)
+{
     p8_reader reader;
     reader.parse(s.c_str());
 
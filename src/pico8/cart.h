@@ -36,6 +36,9 @@ public:
 
     bool load(std::string const &filename);
 
+    // Load a cart from the contents of a .p8 file
+    bool load_p8_data(std::string const &data);
+
     memory const &get_rom() const
     {
         return m_rom;
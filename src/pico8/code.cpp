@@ -197,9 +197,17 @@ static std::string printable(char ch)
                                      : lol::format("$%d", uint8_t(ch));
 }
 
-static uint8_t const *compress_lut = nullptr;
 static char const *decompress_lut = "\n 0123456789abcdefghijklmnopqrstuvwxyz!#%(){}[]<>+=/*:;.,~_";
 
+// The reverse of decompress_lut; built once at startup and never modified
+static std::array<uint8_t, 256> const compress_lut = []()
+{
+    std::array<uint8_t, 256> ret {};
+    for (int i = 0; i < 0x3b; ++i)
+        ret[(uint8_t)decompress_lut[i]] = i + 1;
+    return ret;
+}();
+
 static std::string pxa_decompress(uint8_t const *input)
 {
     size_t length = input[4] * 256 + input[5];
@@ -588,16 +596,6 @@ static std::vector<uint8_t> legacy_compress(std::string const &input)
         0, 0 // FIXME: what is this?
     });
 
-    // Ensure the compression LUT is initialised
-    if (!compress_lut)
-    {
-        uint8_t *tmp = new uint8_t[256];
-        memset(tmp, 0, 256);
-        for (int i = 0; i < 0x3b; ++i)
-            tmp[(uint8_t)decompress_lut[i]] = i + 1;
-        compress_lut = tmp;
-    }
-
     // FIXME: PICO-8 appears to be adding an implicit \n at the end of the code, and ignoring it
     // when compressing code. So for the moment we write one char too many.
     for (int i = 0; i < (int)input.length(); ++i)
@@ -16,8 +16,14 @@
 
 #include <lol/math>  // lol::round, lol::mix
 #include <lol/utils> // lol::format
-#include <algorithm> // std::swap
+#include <algorithm> // std::swap, std::max, std::clamp
+#include <array>     // std::array
+#include <bitset>    // std::bitset
 #include <cmath>     // std::min, std::max
+#include <cstdint>   // INT16_MIN, INT16_MAX
+#include <cstdlib>   // std::abs
+#include <cstring>   // std::memcpy, std::memset
+#include <utility>   // std::integer_sequence
 
 #include "pico8/vm.h"
 #include "bios.h"
@@ -74,7 +80,8 @@ uint8_t vm::get_pixel(int16_t x, int16_t y) const
     if (x < ds.clip.x1 || x >= ds.clip.x2 || y < ds.clip.y1 || y >= ds.clip.y2)
         return 0;
 
-    return m_ram.screen.get(x, y);
+    // The shadow is what a flush would write to screen memory
+    return m_screen.data[y][x];
 }
 
 void vm::set_pixel(int16_t x, int16_t y, uint32_t color_bits)
@@ -85,6 +92,8 @@ void vm::set_pixel(int16_t x, int16_t y, uint32_t color_bits)
     if (x < ds.clip.x1 || x >= ds.clip.x2 || y < ds.clip.y1 || y >= ds.clip.y2)
         return;
 
+    ++m_cost.pixels;
+
     uint8_t color = (color_bits >> 16) & 0xf;
 
     // This is where the fillp pattern is actually handled
@@ -95,16 +104,66 @@ void vm::set_pixel(int16_t x, int16_t y, uint32_t color_bits)
         color = (color_bits >> 20) & 0xf;
     }
 
+    uint8_t &p = m_screen.data[y][x];
     if (hw.bit_mask)
-    {
-        uint8_t old = m_ram.screen.get(x, y);
-        color = (old & ~(hw.bit_mask & 7))
+        color = (p & ~(hw.bit_mask & 7))
               | (color & (hw.bit_mask & 7) & (hw.bit_mask >> 4));
-    }
 
-    m_ram.screen.set(x, y, color);
+    p = color;
+    m_screen.dirty[y] = true;
 }
 
+// Compute what set_pixel() would do to the pixels of row y, for each of
+// the four fill pattern columns: the bits of the old pixel to keep, and
+// the bits to write.
+static void pattern_row(uint32_t color_bits, uint8_t bit_mask, int16_t y,
+                        uint8_t keep[4], uint8_t val[4])
+{
+    uint8_t c1 = (color_bits >> 16) & 0xf;
+    uint8_t c2 = (color_bits >> 20) & 0xf;
+    bool trans = color_bits & 0x1000000;
+
+    for (int i = 0; i < 4; ++i)
+    {
+        bool alt = (color_bits >> (15 - i - 4 * (y & 3))) & 0x1;
+        if (alt && trans)
+        {
+            keep[i] = 0xf;
+            val[i] = 0;
+        }
+        else if (bit_mask)
+        {
+            keep[i] = (~bit_mask & 7) | 8;
+            val[i] = (alt ? c2 : c1) & (bit_mask & 7) & (bit_mask >> 4);
+        }
+        else
+        {
+            keep[i] = 0;
+            val[i] = alt ? c2 : c1;
+        }
+    }
+}
+
+// The same, for all four rows of the fill pattern, for drawing code that
+// does its own clipping and writes single pixels directly to the shadow.
+struct pattern_masks
+{
+    pattern_masks(uint32_t color_bits, uint8_t bit_mask)
+    {
+        for (int i = 0; i < 4; ++i)
+            pattern_row(color_bits, bit_mask, int16_t(i), keep[i], val[i]);
+    }
+
+    void set(screen_shadow &screen, int x, int y) const
+    {
+        uint8_t &p = screen.data[y][x];
+        p = (p & keep[y & 3][x & 3]) | val[y & 3][x & 3];
+        screen.dirty[y] = true;
+    }
+
+    uint8_t keep[4][4], val[4][4];
+};
+
 void vm::hline(int16_t x1, int16_t x2, int16_t y, uint32_t color_bits)
 {
     using std::min, std::max;
@@ -124,31 +183,47 @@ void vm::hline(int16_t x1, int16_t x2, int16_t y, uint32_t color_bits)
     if (x1 > x2)
         return;
 
-    // Cannot use shortcut code when fillp or bitplanes are active
-    if ((color_bits & 0xffff) || hw.bit_mask)
-    {
-        for (int16_t x = x1; x <= x2; ++x)
-            set_pixel(x, y, color_bits);
-    }
-    else
-    {
-        uint8_t *p = m_ram.screen.data[y];
-        uint8_t color = (color_bits >> 16) & 0xf;
+    m_cost.pixels += x2 - x1 + 1;
 
-        if (x1 & 1)
-        {
-            p[x1 / 2] = (p[x1 / 2] & 0x0f) | (color << 4);
-            ++x1;
-        }
+    // The fill pattern and bitplane mask repeat every four pixels
+    uint8_t keep[4], val[4];
+    pattern_row(color_bits, hw.bit_mask, y, keep, val);
 
-        if ((x2 & 1) == 0)
-        {
-            p[x2 / 2] = (p[x2 / 2] & 0xf0) | color;
-            --x2;
-        }
+    uint8_t *p = m_screen.data[y];
+    m_screen.dirty[y] = true;
 
-        ::memset(p + x1 / 2, color * 0x11, (x2 - x1 + 1) / 2);
+    // Plain fills are just a memset()
+    if (!(keep[0] | keep[1] | keep[2] | keep[3])
+         && val[0] == val[1] && val[0] == val[2] && val[0] == val[3])
+    {
+        ::memset(p + x1, val[0], x2 - x1 + 1);
+        return;
     }
+
+    // Otherwise, read-modify-write 8 pixels at a time, starting at a
+    // multiple of 4 so that the masks stay aligned with the pattern.
+    int x = x1, end = x2 + 1;
+    for ( ; x < end && (x & 3); ++x)
+        p[x] = (p[x] & keep[x & 3]) | val[x & 3];
+
+    uint64_t kkkk, vvvv;
+    uint8_t const k8[8] = { keep[0], keep[1], keep[2], keep[3],
+                            keep[0], keep[1], keep[2], keep[3] };
+    uint8_t const v8[8] = { val[0], val[1], val[2], val[3],
+                            val[0], val[1], val[2], val[3] };
+    ::memcpy(&kkkk, k8, sizeof(kkkk));
+    ::memcpy(&vvvv, v8, sizeof(vvvv));
+
+    for ( ; x + 8 <= end; x += 8)
+    {
+        uint64_t data;
+        ::memcpy(&data, p + x, sizeof(data));
+        data = (data & kkkk) | vvvv;
+        ::memcpy(p + x, &data, sizeof(data));
+    }
+
+    for ( ; x < end; ++x)
+        p[x] = (p[x] & keep[x & 3]) | val[x & 3];
 }
 
 void vm::vline(int16_t x, int16_t y1, int16_t y2, uint32_t color_bits)
@@ -170,24 +245,198 @@ void vm::vline(int16_t x, int16_t y1, int16_t y2, uint32_t color_bits)
     if (y1 > y2)
         return;
 
-    // Cannot use shortcut code when fillp or bitplanes are active
-    if ((color_bits & 0xffff) || hw.bit_mask)
+    m_cost.pixels += y2 - y1 + 1;
+
+    // The pattern repeats every four rows; compute the masks of column x
+    // for each of them.
+    pattern_masks masks(color_bits, hw.bit_mask);
+
+    for (int16_t y = y1; y <= y2; ++y)
+        masks.set(m_screen, x, y);
+}
+
+// What set_pixel() does with the bitplane mask: the bits of the old pixel
+// to keep, and the bits of the new colour to write
+struct bit_mask_bits
+{
+    bit_mask_bits(uint8_t bit_mask)
+      : keep((~bit_mask & 7) | 8),
+        write(bit_mask & 7 & (bit_mask >> 4))
+    {}
+
+    uint8_t keep, write;
+};
+
+// Write colour c to pixel x of a screen shadow row, going through the
+// bitplane mask if there is one
+template<bool BIT_MASK>
+static inline void put_pixel(uint8_t *dst, int x, uint8_t c, bit_mask_bits const &bm)
+{
+    uint8_t &p = dst[x];
+    if constexpr (BIT_MASK)
+        c = (p & bm.keep) | (c & bm.write);
+    p = c;
+}
+
+void gfx_cache::invalidate(int addr, int size)
+{
+    // Sprite n covers 8 rows of 4 bytes each, starting at byte
+    // n / 16 * 512 + n % 16 * 4; handle one 64-byte sheet row at a time.
+    int end = std::min(addr + size, 0x2000);
+    for (addr = std::max(addr, 0); addr < end; addr = (addr | 63) + 1)
     {
-        for (int16_t y = y1; y <= y2; ++y)
-            set_pixel(x, y, color_bits);
+        int last = std::min(end - 1, addr | 63);
+        for (int n = addr % 64 / 4; n <= last % 64 / 4; ++n)
+            dirty.set(addr / 512 * 16 + n);
     }
-    else
+}
+
+void gfx_cache::update(u4mat2<128, 128> const &gfx)
+{
+    if (dirty.none())
+        return;
+
+    for (int n = 0; n < 256; ++n)
     {
-        uint8_t mask = (x & 1) ? 0x0f : 0xf0;
-        uint8_t color = (color_bits >> 16) & 0xf;
-        uint8_t p = (x & 1) ? color << 4 : color;
+        if (!dirty[n])
+            continue;
+
+        for (int y = n / 16 * 8; y < n / 16 * 8 + 8; ++y)
+            for (int x = n % 16 * 8; x < n % 16 * 8 + 8; x += 2)
+            {
+                uint8_t b = gfx.data[y][x / 2];
+                data[y][x] = b & 0xf;
+                data[y][x + 1] = b >> 4;
+            }
+    }
 
-        for (int16_t y = y1; y <= y2; ++y)
+    dirty.reset();
+}
+
+void screen_shadow::flush(u4mat2<128, 128> &screen)
+{
+    for (int y = 0; y < 128; ++y)
+    {
+        if (!dirty[y])
+            continue;
+
+        // Pack 8 pixels at a time: fold each odd byte into the high nibble
+        // of the previous one, then gather the even bytes. This relies on
+        // little-endian byte order, like the rest of the memory layout.
+        for (int x = 0; x < 128; x += 8)
         {
-            auto &data = m_ram.screen.data[y][x / 2];
-            data = (data & mask) | p;
+            uint64_t v;
+            ::memcpy(&v, data[y] + x, sizeof(v));
+            v = (v | v >> 4) & 0x00ff00ff00ff00ffull;
+            v = (v | v >> 8) & 0x0000ffff0000ffffull;
+            uint32_t packed = uint32_t(v | v >> 16);
+            ::memcpy(screen.data[y] + x / 2, &packed, sizeof(packed));
         }
+
+        dirty[y] = false;
+    }
+}
+
+void screen_shadow::load(u4mat2<128, 128> const &screen, int offset, int size)
+{
+    int first = std::max(offset, 0) / 64;
+    int last = std::min(offset + size - 1, 0x1fff) / 64;
+
+    for (int y = first; y <= last; ++y)
+    {
+        for (int x = 0; x < 128; x += 2)
+        {
+            uint8_t b = screen.data[y][x / 2];
+            data[y][x] = b & 0xf;
+            data[y][x + 1] = b >> 4;
+        }
+        dirty[y] = false;
+    }
+}
+
+// Sprite blitting kernels. Copy a w×h block of gfx pixels, read from the
+// sprite cache, to the screen shadow; (sx, sy) is the source pixel for the
+// destination pixel (dx, dy), and both rectangles have already been
+// clipped. The kernels are specialised
+// on the flip flags, on whether the draw palette is the identity, on
+// whether any colour is transparent, and on whether a bitplane mask is
+// active. They return the number of pixels actually drawn, for the CPU
+// cost model.
+template<bool FLIP_X, bool FLIP_Y, bool IDENTITY, bool OPAQUE, bool BIT_MASK>
+static int64_t blit_kernel(memory &ram, gfx_cache const &gfx, screen_shadow &screen,
+                           int sx, int sy, int dx, int dy, int w, int h)
+{
+    auto const &pal = ram.draw_state.draw_palette;
+    bit_mask_bits const bm(ram.hw_state.bit_mask);
+    int64_t pixels = 0;
+
+    for (int j = 0; j < h; ++j)
+    {
+        int y = FLIP_Y ? sy - j : sy + j;
+        uint8_t *dst = screen.data[dy + j];
+        uint8_t const *src = gfx.data[y];
+        screen.dirty[dy + j] = true;
+
+        // Without any colour change, rows are copied as they are
+        if constexpr (IDENTITY && OPAQUE && !FLIP_X && !BIT_MASK)
+        {
+            ::memcpy(dst + dx, src + sx, w);
+            pixels += w;
+            continue;
+        }
+
+        for (int i = 0; i < w; ++i)
+        {
+            uint8_t c = src[FLIP_X ? sx - i : sx + i];
+
+            if constexpr (!OPAQUE)
+                if (pal[c] & 0x10)
+                    continue;
+            if constexpr (!IDENTITY)
+                c = pal[c] & 0xf;
+
+            put_pixel<BIT_MASK>(dst, dx + i, c, bm);
+            ++pixels;
+        }
+    }
+
+    return pixels;
+}
+
+using blit_fn = int64_t (*)(memory &, gfx_cache const &, screen_shadow &,
+                            int, int, int, int, int, int);
+
+template<int... N>
+static constexpr std::array<blit_fn, sizeof...(N)> make_blit_kernels(std::integer_sequence<int, N...>)
+{
+    return { &blit_kernel<(N & 1) != 0, (N & 2) != 0, (N & 4) != 0,
+                          (N & 8) != 0, (N & 16) != 0>... };
+}
+
+// All kernels, indexed by the draw state key built below
+static constexpr auto blit_kernels = make_blit_kernels(std::make_integer_sequence<int, 32>());
+
+// Compute the draw state part of the kernel key: whether the draw palette
+// is the identity and whether it has no transparent colour, and whether
+// the bitplane mask is active. Sprites ignore the fill pattern.
+static int blit_key(memory const &ram)
+{
+    auto const &ds = ram.draw_state;
+
+    bool identity = true, opaque = true;
+    for (int c = 0; c < 16; ++c)
+    {
+        identity &= (ds.draw_palette[c] & 0xf) == c;
+        opaque &= (ds.draw_palette[c] & 0x10) == 0;
     }
+
+    return identity << 2 | opaque << 3 | (ram.hw_state.bit_mask != 0) << 4;
+}
+
+// Pick the kernel matching the flip flags and the current draw state
+static blit_fn select_blit_kernel(memory const &ram, bool flip_x, bool flip_y)
+{
+    return blit_kernels[flip_x | flip_y << 1 | blit_key(ram)];
 }
 
 
@@ -207,6 +456,73 @@ tup<uint8_t, uint8_t, uint8_t> vm::api_cursor(uint8_t x, uint8_t y, opt<uint8_t>
     return std::make_tuple(x, y, c);
 }
 
+// Expand each bit of a byte to a full byte, for row mask blitting
+static constexpr std::array<uint64_t, 256> byte_masks = []()
+{
+    std::array<uint64_t, 256> ret {};
+    for (int n = 0; n < 256; ++n)
+        for (int i = 0; i < 8; ++i)
+            if (n & (1 << i))
+                ret[n] |= uint64_t(0xff) << (8 * i);
+    return ret;
+}();
+
+// Draw a glyph of at most 8×8 pixels, given as one bitmask per row, with
+// its top-left corner at (x, y). Columns are clipped once per glyph, then
+// each visible row is written at once with a masked read-modify-write.
+void vm::glyph(uint8_t const *rows, int16_t w, int16_t h,
+               int16_t x, int16_t y, uint32_t color_bits)
+{
+    auto &ds = m_ram.draw_state;
+
+    // Find the visible columns
+    uint8_t cols = 0;
+    for (int16_t dx = 0; dx < w; ++dx)
+    {
+        int16_t sx = x + dx;
+        cols |= (sx >= ds.clip.x1 && sx < ds.clip.x2) << dx;
+    }
+
+    if (!cols)
+        return;
+
+    // Start at the first visible column; the glyph is at most 8 pixels
+    // wide, so each row fits in a 64-bit word.
+    int x0 = std::max(int(x), int(ds.clip.x1));
+    cols >>= x0 - x;
+
+    pattern_masks masks(color_bits, m_ram.hw_state.bit_mask);
+
+    for (int16_t dy = 0; dy < h; ++dy)
+    {
+        int16_t sy = y + dy;
+        if (sy < ds.clip.y1 || sy >= ds.clip.y2)
+            continue;
+
+        uint8_t bits = (rows[dy] >> (x0 - x)) & cols;
+        if (!bits)
+            continue;
+
+        m_cost.pixels += std::bitset<8>(bits).count();
+
+        // The glyph colour has no fill pattern, so all cells are the same
+        uint64_t bm = byte_masks[bits];
+        uint64_t keep = masks.keep[sy & 3][0] * 0x0101010101010101ull;
+        uint64_t val = masks.val[sy & 3][0] * 0x0101010101010101ull;
+
+        uint8_t *p = m_screen.data[sy] + x0;
+        int n = std::min(8, 128 - x0);
+        m_screen.dirty[sy] = true;
+
+        uint64_t data = 0;
+        for (int i = 0; i < n; ++i)
+            data |= uint64_t(p[i]) << 8 * i;
+        data = (data & (~bm | keep)) | (val & bm);
+        for (int i = 0; i < n; ++i)
+            p[i] = uint8_t(data >> 8 * i);
+    }
+}
+
 void vm::api_print(opt<rich_string> str, opt<fix32> opt_x, opt<fix32> opt_y,
                    opt<fix32> c)
 {
@@ -257,21 +573,11 @@ void vm::api_print(opt<rich_string> str, opt<fix32> opt_x, opt<fix32> opt_y,
                 {
                     int16_t w = std::min(int(ch < 0x80 ? font.width : font.extended_width), 8);
                     int16_t h = std::min(int(font.height), 8);
-                    auto &g = font.glyphs[ch - 1];
 
-                    for (int16_t dy = 0; dy < h; ++dy)
-                    {
-                        uint8_t gl = g[dy];
-
-                        for (int16_t dx = 0; dx < w; ++dx, gl >>= 1)
-                        {
-                            int16_t screen_x = (int16_t)x - ds.camera.x + dx + font.offset.x;
-                            int16_t screen_y = (int16_t)y - ds.camera.y + dy + font.offset.y;
-
-                            if (gl & 0x1)
-                                set_pixel(screen_x, screen_y, color_bits);
-                        }
-                    }
+                    // Custom glyphs are already stored as row bitmasks
+                    glyph(font.glyphs[ch - 1], w, h,
+                          (int16_t)x - ds.camera.x + font.offset.x,
+                          (int16_t)y - ds.camera.y + font.offset.y, color_bits);
 
                     x += fix32(w);
                     height = std::max(height, int16_t(font.height));
@@ -279,19 +585,10 @@ void vm::api_print(opt<rich_string> str, opt<fix32> opt_x, opt<fix32> opt_y,
                 else
                 {
                     int16_t w = ch < 0x80 ? 4 : 8;
-                    int offset = ch < 0x80 ? ch : 2 * ch - 0x80;
-                    int font_x = offset % 32 * 4;
-                    int font_y = offset / 32 * 6;
-
-                    for (int16_t dy = 0; dy < 5; ++dy)
-                        for (int16_t dx = 0; dx < w; ++dx)
-                        {
-                            int16_t screen_x = (int16_t)x - ds.camera.x + dx;
-                            int16_t screen_y = (int16_t)y - ds.camera.y + dy;
 
-                            if (m_bios->get_spixel(font_x + dx, font_y + dy))
-                                set_pixel(screen_x, screen_y, color_bits);
-                        }
+                    glyph(m_bios->get_glyph(ch), w, 5,
+                          (int16_t)x - ds.camera.x,
+                          (int16_t)y - ds.camera.y, color_bits);
 
                     x += fix32(w);
                 }
@@ -314,9 +611,10 @@ void vm::api_print(opt<rich_string> str, opt<fix32> opt_x, opt<fix32> opt_y,
         // FIXME: is this affected by the camera?
         if (y > fix32(128.0 - 2 * height))
         {
-            uint8_t *s = m_ram.screen.data[0];
-            memmove(s, s + height * 64, sizeof(m_ram.screen) - height * 64);
-            ::memset(s + sizeof(m_ram.screen) - height * 64, 0, height * 64);
+            uint8_t *s = m_screen.data[0];
+            memmove(s, s + height * 128, sizeof(m_screen.data) - height * 128);
+            ::memset(s + sizeof(m_screen.data) - height * 128, 0, height * 128);
+            m_screen.dirty.fill(true);
             y -= fix32(height);
         }
 
@@ -339,6 +637,49 @@ tup<int16_t, int16_t> vm::api_camera(int16_t x, int16_t y)
     return std::make_tuple(prev.x, prev.y);
 }
 
+// Trace one octant of a circle of radius r, from (r, 0) to the diagonal
+class circle_dda
+{
+public:
+    circle_dda(int16_t r) : dx(r), m_r(r) {}
+
+    bool done() const { return dx < dy; }
+
+    void step()
+    {
+        dy += 1;
+        m_err += 1 + 2 * dy;
+        // XXX: original Bresenham has a different test, but
+        // this one seems to match PICO-8 better.
+        if (2 * (m_err - dx) > m_r + 1)
+        {
+            dx -= 1;
+            m_err += 1 - 2 * dx;
+        }
+    }
+
+    int16_t dx, dy = 0;
+
+private:
+    int16_t m_r, m_err = 0;
+};
+
+// Check whether the box [x0,x1]×[y0,y1] can be drawn to without any
+// coordinate wrapping around, and whether it is visible at all or even
+// fully visible.
+enum class box_clip { wraps, hidden, partial, inside };
+
+static box_clip clip_box(draw_state_t const &ds, int x0, int y0, int x1, int y1)
+{
+    if (x0 < INT16_MIN || y0 < INT16_MIN || x1 > INT16_MAX || y1 > INT16_MAX)
+        return box_clip::wraps;
+    if (x1 < ds.clip.x1 || x0 >= ds.clip.x2 || y1 < ds.clip.y1 || y0 >= ds.clip.y2)
+        return box_clip::hidden;
+    if (x0 >= ds.clip.x1 && x1 < ds.clip.x2 && y0 >= ds.clip.y1 && y1 < ds.clip.y2)
+        return box_clip::inside;
+    return box_clip::partial;
+}
+
 void vm::api_circ(int16_t x, int16_t y, int16_t r, opt<fix32> c)
 {
     auto &ds = m_ram.draw_state;
@@ -347,26 +688,69 @@ void vm::api_circ(int16_t x, int16_t y, int16_t r, opt<fix32> c)
     y -= ds.camera.y;
     uint32_t color_bits = to_color_bits(c);
 
-    for (int16_t dx = r, dy = 0, err = 0; dx >= dy; )
+    if (r < 0)
+        return;
+
+    auto clip = clip_box(ds, x - r, y - r, x + r, y + r);
+    if (clip == box_clip::hidden)
+        return;
+
+    // Fully visible circles need no clipping at all
+    if (clip == box_clip::inside)
     {
-        set_pixel(x + dx, y + dy, color_bits);
-        set_pixel(x + dy, y + dx, color_bits);
-        set_pixel(x - dy, y + dx, color_bits);
-        set_pixel(x - dx, y + dy, color_bits);
-        set_pixel(x - dx, y - dy, color_bits);
-        set_pixel(x - dy, y - dx, color_bits);
-        set_pixel(x + dy, y - dx, color_bits);
-        set_pixel(x + dx, y - dy, color_bits);
+        pattern_masks masks(color_bits, m_ram.hw_state.bit_mask);
 
-        dy += 1;
-        err += 1 + 2 * dy;
-        // XXX: original Bresenham has a different test, but
-        // this one seems to match PICO-8 better.
-        if (2 * (err - dx) > r + 1)
+        for (circle_dda o(r); !o.done(); o.step())
         {
-            dx -= 1;
-            err += 1 - 2 * dx;
+            masks.set(m_screen, x + o.dx, y + o.dy);
+            masks.set(m_screen, x + o.dy, y + o.dx);
+            masks.set(m_screen, x - o.dy, y + o.dx);
+            masks.set(m_screen, x - o.dx, y + o.dy);
+            masks.set(m_screen, x - o.dx, y - o.dy);
+            masks.set(m_screen, x - o.dy, y - o.dx);
+            masks.set(m_screen, x + o.dy, y - o.dx);
+            masks.set(m_screen, x + o.dx, y - o.dy);
+            m_cost.pixels += 8;
         }
+        return;
+    }
+
+    // Otherwise, skip the octants that are entirely clipped. Along the
+    // traced octant, dy goes from 0 to some dymax and dx from r down to
+    // at least dymax, which gives each octant’s bounding box.
+    bool visible[8];
+    if (clip == box_clip::partial)
+    {
+        int dymax = 0;
+        for (circle_dda o(r); !o.done(); o.step())
+            dymax = o.dy;
+
+        for (int i = 0; i < 8; ++i)
+        {
+            int sx = i & 1 ? -1 : 1, sy = i & 2 ? -1 : 1;
+            bool swap = i & 4;
+            int ax0 = swap ? 0 : dymax, ax1 = swap ? dymax : r;
+            int ay0 = swap ? dymax : 0, ay1 = swap ? r : dymax;
+            visible[i] = clip_box(ds, sx > 0 ? x + ax0 : x - ax1, sy > 0 ? y + ay0 : y - ay1,
+                                  sx > 0 ? x + ax1 : x - ax0, sy > 0 ? y + ay1 : y - ay0)
+                             != box_clip::hidden;
+        }
+    }
+    else
+    {
+        std::fill(visible, visible + 8, true);
+    }
+
+    for (circle_dda o(r); !o.done(); o.step())
+    {
+        if (visible[0]) set_pixel(x + o.dx, y + o.dy, color_bits);
+        if (visible[4]) set_pixel(x + o.dy, y + o.dx, color_bits);
+        if (visible[5]) set_pixel(x - o.dy, y + o.dx, color_bits);
+        if (visible[1]) set_pixel(x - o.dx, y + o.dy, color_bits);
+        if (visible[3]) set_pixel(x - o.dx, y - o.dy, color_bits);
+        if (visible[7]) set_pixel(x - o.dy, y - o.dx, color_bits);
+        if (visible[6]) set_pixel(x + o.dy, y - o.dx, color_bits);
+        if (visible[2]) set_pixel(x + o.dx, y - o.dy, color_bits);
     }
 }
 
@@ -378,22 +762,43 @@ void vm::api_circfill(int16_t x, int16_t y, int16_t r, opt<fix32> c)
     y -= ds.camera.y;
     uint32_t color_bits = to_color_bits(c);
 
-    for (int16_t dx = r, dy = 0, err = 0; dx >= dy; )
+    if (r < 0)
+        return;
+
+    auto clip = clip_box(ds, x - r, y - r, x + r, y + r);
+    if (clip == box_clip::hidden)
+        return;
+
+    if (clip == box_clip::wraps)
     {
-        /* Some minor overdraw here, but nothing serious */
+        // Coordinates wrap around; keep drawing the original way
+        for (circle_dda o(r); !o.done(); o.step())
+        {
+            hline(x - o.dx, x + o.dx, y - o.dy, color_bits);
+            hline(x - o.dx, x + o.dx, y + o.dy, color_bits);
+            vline(x - o.dy, y - o.dx, y + o.dx, color_bits);
+            vline(x + o.dy, y - o.dx, y + o.dx, color_bits);
+        }
+        return;
+    }
+
+    // Otherwise, emit each row exactly once. Rows up to the end of the octant are
+    // as wide as the traced dx; each time dx decreases, row dx is as wide
+    // as the last dy it was reached at, unless the octant covers it too.
+    for (circle_dda o(r); !o.done(); )
+    {
+        int16_t dx = o.dx, dy = o.dy;
+
         hline(x - dx, x + dx, y - dy, color_bits);
-        hline(x - dx, x + dx, y + dy, color_bits);
-        vline(x - dy, y - dx, y + dx, color_bits);
-        vline(x + dy, y - dx, y + dx, color_bits);
+        if (dy)
+            hline(x - dx, x + dx, y + dy, color_bits);
 
-        dy += 1;
-        err += 1 + 2 * dy;
-        // XXX: original Bresenham has a different test, but
-        // this one seems to match PICO-8 better.
-        if (2 * (err - dx) > r + 1)
+        o.step();
+
+        if (o.dx < dx && dx > dy)
         {
-            dx -= 1;
-            err += 1 - 2 * dx;
+            hline(x - dy, x + dy, y - dx, color_bits);
+            hline(x - dy, x + dy, y + dx, color_bits);
         }
     }
 }
@@ -410,10 +815,10 @@ tup<uint8_t, uint8_t, uint8_t, uint8_t> vm::api_clip(int16_t x, int16_t y,
     // All three arguments are required for the non-default behaviour
     if (h)
     {
-        x2 = uint8_t(std::min(int16_t(x2), int16_t(x + w)));
-        y2 = uint8_t(std::min(int16_t(y2), int16_t(y + *h)));
-        x1 = uint8_t(std::max(int16_t(x1), x));
-        y1 = uint8_t(std::max(int16_t(y1), y));
+        x2 = uint8_t(std::clamp(std::min(int(x2), x + w), 0, 128));
+        y2 = uint8_t(std::clamp(std::min(int(y2), y + *h), 0, 128));
+        x1 = uint8_t(std::clamp(std::max(int(x1), int(x)), 0, 128));
+        y1 = uint8_t(std::clamp(std::max(int(y1), int(y)), 0, 128));
     }
 
     std::swap(ds.clip.x1, x1);
@@ -426,7 +831,9 @@ tup<uint8_t, uint8_t, uint8_t, uint8_t> vm::api_clip(int16_t x, int16_t y,
 
 void vm::api_cls(uint8_t c)
 {
-    ::memset(&m_ram.screen, c % 0x10 * 0x11, sizeof(m_ram.screen));
+    ::memset(m_screen.data, c % 0x10, sizeof(m_screen.data));
+    m_screen.dirty.fill(true);
+    m_cost.pixels += 128 * 128;
 
     // Documentation: “Clear the screen and reset the clipping rectangle”.
     auto &ds = m_ram.draw_state;
@@ -488,6 +895,54 @@ void vm::api_fset(opt<int16_t> n, opt<int16_t> f, opt<bool> b)
         data &= ~(1 << *f);
 }
 
+// Compute round(mix(a, b, m / n)) for m = m0, m0 + 1…, the way the
+// floating point formula does but using integers only. Exact ties are rare
+// and go through the floating point formula, so that rounding is always
+// identical. A zero-length line (n = 0) stays at a.
+class lerp_dda
+{
+public:
+    lerp_dda(int a, int b, int n, int m0)
+      : m_a(a), m_b(b), m_n(std::max(n, 1)), m_m(m0)
+    {
+        // Track floor((2 * (b - a) * m + n) / 2n) as quotient/remainder
+        int64_t den = 2 * int64_t(m_n);
+        int64_t v = 2 * int64_t(b - a) * m0 + m_n;
+        m_q = floordiv(v, den);
+        m_r = v - m_q * den;
+        m_qstep = floordiv(2 * int64_t(b - a), den);
+        m_rstep = 2 * int64_t(b - a) - m_qstep * den;
+    }
+
+    int16_t get() const
+    {
+        if (m_r == 0)
+            return (int16_t)lol::round(lol::mix((double)m_a, (double)m_b, (double)m_m / m_n));
+        return int16_t(m_a + m_q);
+    }
+
+    void step()
+    {
+        ++m_m;
+        m_q += m_qstep;
+        m_r += m_rstep;
+        if (m_r >= 2 * m_n)
+        {
+            m_r -= 2 * m_n;
+            ++m_q;
+        }
+    }
+
+private:
+    static int64_t floordiv(int64_t a, int64_t b)
+    {
+        return a / b - (a % b != 0 && (a < 0) != (b < 0));
+    }
+
+    int m_a, m_b, m_n, m_m;
+    int64_t m_q, m_r, m_qstep, m_rstep;
+};
+
 void vm::api_line(opt<fix32> arg0, opt<fix32> arg1, opt<fix32> arg2,
                   opt<fix32> arg3, opt<fix32> arg4)
 {
@@ -539,34 +994,74 @@ void vm::api_line(opt<fix32> arg0, opt<fix32> arg1, opt<fix32> arg2,
     x0 -= ds.camera.x; y0 -= ds.camera.y;
     x1 -= ds.camera.x; y1 -= ds.camera.y;
 
-    bool horiz = abs(x1 - x0) >= abs(y1 - y0);
-    int16_t dx = x0 <= x1 ? 1 : -1;
-    int16_t dy = y0 <= y1 ? 1 : -1;
+    // Cohen–Sutherland trivial rejection: nothing to draw if both ends
+    // are on the same outer side of the clip rectangle.
+    auto outcode = [&](int x, int y)
+    {
+        return (x < ds.clip.x1) | (x >= ds.clip.x2) << 1
+             | (y < ds.clip.y1) << 2 | (y >= ds.clip.y2) << 3;
+    };
 
-    // Clamping helps with performance even if pixels are clipped later
-    int16_t x = lol::clamp(int(x0), -1, 128);
-    int16_t y = lol::clamp(int(y0), -1, 128);
-    int16_t xend = lol::clamp(int(x1), -1, 128);
-    int16_t yend = lol::clamp(int(y1), -1, 128);
+    if (outcode(x0, y0) & outcode(x1, y1))
+        return;
 
-    for (;;)
+    // Axis-aligned lines are just spans
+    if (y0 == y1)
+        return hline(x0, x1, y0, color_bits);
+    if (x0 == x1)
+        return vline(x0, y0, y1, color_bits);
+
+    // Work along the major axis; pixel m of the line is at a0 + m * da on
+    // that axis, and at round(mix(b0, b1, m / n)) on the other one.
+    bool horiz = abs(x1 - x0) >= abs(y1 - y0);
+    int a0 = horiz ? x0 : y0, a1 = horiz ? x1 : y1;
+    int b0 = horiz ? y0 : x0, b1 = horiz ? y1 : x1;
+    int alo = horiz ? ds.clip.x1 : ds.clip.y1, ahi = (horiz ? ds.clip.x2 : ds.clip.y2) - 1;
+    int blo = horiz ? ds.clip.y1 : ds.clip.x1, bhi = (horiz ? ds.clip.y2 : ds.clip.x2) - 1;
+    int da = a0 <= a1 ? 1 : -1;
+    int n = abs(a1 - a0);
+
+    // Clip against the major axis bounds
+    int mfirst = max(0, da > 0 ? alo - a0 : a0 - ahi);
+    int mlast = min(n, da > 0 ? ahi - a0 : a0 - alo);
+
+    // The minor coordinate is monotonic in m, so the pixels inside the
+    // minor axis bounds form a single run; find it by bisection.
+    auto minor_at = [&](int m) { return lerp_dda(b0, b1, n, m).get(); };
+    bool rising = b0 <= b1;
+
+    for (int lo = mfirst, hi = mlast + 1; lo < hi; )
     {
-        set_pixel(x, y, color_bits);
+        int mid = (lo + hi) / 2;
+        int b = minor_at(mid);
+        if (rising ? b < blo : b > bhi)
+            lo = mfirst = mid + 1;
+        else
+            hi = mid;
+    }
 
-        if (horiz)
-        {
-            if (x == xend)
-                break;
-            x += dx;
-            y = (int16_t)lol::round(lol::mix((double)y0, (double)y1, (double)(x - x0) / (x1 - x0)));
-        }
+    for (int lo = mfirst - 1, hi = mlast; lo < hi; )
+    {
+        int mid = (lo + hi + 1) / 2;
+        int b = minor_at(mid);
+        if (rising ? b > bhi : b < blo)
+            hi = mlast = mid - 1;
         else
-        {
-            if (y == yend)
-                break;
-            y += dy;
-            x = (int16_t)lol::round(lol::mix((double)x0, (double)x1, (double)(y - y0) / (y1 - y0)));
-        }
+            lo = mid;
+    }
+
+    if (mfirst > mlast)
+        return;
+
+    m_cost.pixels += mlast - mfirst + 1;
+
+    pattern_masks masks(color_bits, m_ram.hw_state.bit_mask);
+
+    lerp_dda minor(b0, b1, n, mfirst);
+    for (int m = mfirst; m <= mlast; ++m, minor.step())
+    {
+        int a = a0 + m * da, b = minor.get();
+        masks.set(m_screen, horiz ? a : b, horiz ? b : a);
     }
 }
 
@@ -576,6 +1071,7 @@ void vm::api_tline(int16_t x0, int16_t y0, int16_t x1, int16_t y1,
     using std::abs, std::min;
 
     auto &ds = m_ram.draw_state;
+    auto &hw = m_ram.hw_state;
 
     // mdx, mdy default to 1/8, 0
     fix32 mdx = in_mdx ? *in_mdx : fix32::frombits(0x2000);
@@ -608,29 +1104,87 @@ void vm::api_tline(int16_t x0, int16_t y0, int16_t x1, int16_t y1,
         delta -= step;
     }
 
-    for (;;)
+    m_gfx_cache.update(m_ram.gfx);
+
+    // Look up the sprite in map memory only when the source coordinates
+    // cross a cell or a sprite row boundary. Returns the draw palette
+    // entry for the current source pixel, or -1 if there is nothing to
+    // draw at all.
+    int cache_x = -1, cache_y = -1, cache_row = -1;
+    uint8_t const *row = nullptr;
+    int row_x = 0;
+
+    auto fetch = [&]() -> int
     {
-        // Find sprite in map memory
         int sx = (ds.tline.offset.x + int(mx)) & 0x7f;
         int sy = (ds.tline.offset.y + int(my)) & 0x3f;
-        uint8_t sprite = m_ram.map[128 * sy + sx];
-        uint8_t bits = m_ram.gfx_flags[sprite];
+        int ty = int(my << 3) & 0x7;
 
-        // If found, draw pixel
-        if ((sprite || ds.sprite_zero == 0x8) && (!layer || (bits & layer)))
+        if (sx != cache_x || sy != cache_y || ty != cache_row)
         {
-            int col = m_ram.gfx.get(sprite % 16 * 8 + (int(mx << 3) & 0x7),
-                                    sprite / 16 * 8 + (int(my << 3) & 0x7));
-            if ((ds.draw_palette[col] & 0x10) == 0)
-            {
-                uint32_t color_bits = (ds.draw_palette[col] & 0xf) << 16;
-                set_pixel(x, y, color_bits);
-            }
+            cache_x = sx; cache_y = sy; cache_row = ty;
+
+            uint8_t sprite = m_ram.map[128 * sy + sx];
+            uint8_t bits = m_ram.gfx_flags[sprite];
+            bool visible = (sprite || ds.sprite_zero == 0x8) && (!layer || (bits & layer));
+            row = visible ? m_gfx_cache.data[sprite / 16 * 8 + ty] : nullptr;
+            row_x = sprite % 16 * 8;
         }
 
-        // Advance source coordinates
+        if (!row)
+            return -1;
+
+        return ds.draw_palette[row[row_x + (int(mx << 3) & 0x7)]];
+    };
+
+    auto advance = [&]()
+    {
         mx = (mx & ~xmask) | ((mx + mdx) & xmask);
         my = (my & ~ymask) | ((my + mdy) & ymask);
+    };
+
+    // Horizontal scanlines, as used by mode 7 floors, stay on the same
+    // screen row and can write pixels directly.
+    if (horiz && y0 == y1 && !hw.bit_mask)
+    {
+        if (y < ds.clip.y1 || y >= ds.clip.y2)
+            return;
+
+        uint8_t *dst = m_screen.data[y];
+        m_screen.dirty[y] = true;
+
+        for (;;)
+        {
+            if (x >= ds.clip.x1 && x < ds.clip.x2)
+            {
+                int c = fetch();
+                if (c >= 0 && (c & 0x10) == 0)
+                {
+                    ++m_cost.pixels;
+                    dst[x] = c & 0xf;
+                }
+            }
+
+            advance();
+
+            if (x == xend)
+                break;
+            x += dx;
+        }
+        return;
+    }
+
+    // Otherwise, step the minor axis coordinate along the line
+    lerp_dda minor = horiz ? lerp_dda(y0, y1, abs(x1 - x0), (x - x0) * dx)
+                           : lerp_dda(x0, x1, abs(y1 - y0), (y - y0) * dy);
+
+    for (;;)
+    {
+        int c = fetch();
+        if (c >= 0 && (c & 0x10) == 0)
+            set_pixel(x, y, (c & 0xf) << 16);
+
+        advance();
 
         // Advance destination coordinates
         if (horiz)
@@ -638,14 +1192,16 @@ void vm::api_tline(int16_t x0, int16_t y0, int16_t x1, int16_t y1,
             if (x == xend)
                 break;
             x += dx;
-            y = (int16_t)lol::round(lol::mix((double)y0, (double)y1, (double)(x - x0) / (x1 - x0)));
+            minor.step();
+            y = minor.get();
         }
         else
         {
             if (y == yend)
                 break;
             y += dy;
-            x = (int16_t)lol::round(lol::mix((double)x0, (double)x1, (double)(y - y0) / (y1 - y0)));
+            minor.step();
+            x = minor.get();
         }
     }
 }
@@ -654,6 +1210,8 @@ void vm::api_tline(int16_t x0, int16_t y0, int16_t x1, int16_t y1,
 void vm::api_map(int16_t cel_x, int16_t cel_y, int16_t sx, int16_t sy,
                  opt<int16_t> in_cel_w, opt<int16_t> in_cel_h, int16_t layer)
 {
+    using std::min, std::max;
+
     auto &ds = m_ram.draw_state;
 
     sx -= ds.camera.x;
@@ -677,29 +1235,38 @@ void vm::api_map(int16_t cel_x, int16_t cel_y, int16_t sx, int16_t sy,
     sx += mx;
     sy += my;
 
-    for (int16_t dy = 0; dy < src_h; ++dy)
-    for (int16_t dx = 0; dx < src_w; ++dx)
-    {
-        int16_t cx = (src_x + dx) / 8;
-        int16_t cy = (src_y + dy) / 8;
-        if (cx < 0 || cx >= 128 || cy < 0 || cy >= 64)
-            continue;
+    // Intersect with the clipping rectangle, then work on map pixels
+    int x0 = max(int(sx), int(ds.clip.x1)), x1 = min(sx + src_w, int(ds.clip.x2));
+    int y0 = max(int(sy), int(ds.clip.y1)), y1 = min(sy + src_h, int(ds.clip.y2));
+    int px0 = src_x + x0 - sx, px1 = src_x + x1 - sx;
+    int py0 = src_y + y0 - sy, py1 = src_y + y1 - sy;
 
+    // Cells outside the map are empty
+    px0 = max(px0, 0); px1 = min(px1, 128 * 8);
+    py0 = max(py0, 0); py1 = min(py1, 64 * 8);
+    if (px0 >= px1 || py0 >= py1)
+        return;
+
+    auto kernel = select_blit_kernel(m_ram, false, false);
+    m_gfx_cache.update(m_ram.gfx);
+
+    for (int cy = py0 / 8; cy <= (py1 - 1) / 8; ++cy)
+    for (int cx = px0 / 8; cx <= (px1 - 1) / 8; ++cx)
+    {
+        // Skip whole cells that are empty or filtered out
         uint8_t sprite = m_ram.map[128 * cy + cx];
-        uint8_t bits = m_ram.gfx_flags[sprite];
-        if (layer && !(bits & layer))
+        if (layer && !(m_ram.gfx_flags[sprite] & layer))
+            continue;
+        if (!sprite && ds.sprite_zero != 0x8)
             continue;
 
-        if (sprite || ds.sprite_zero == 0x8)
-        {
-            int col = m_ram.gfx.get(sprite % 16 * 8 + (src_x + dx) % 8,
-                                    sprite / 16 * 8 + (src_y + dy) % 8);
-            if ((ds.draw_palette[col] & 0x10) == 0)
-            {
-                uint32_t color_bits = (ds.draw_palette[col] & 0xf) << 16;
-                set_pixel(sx + dx, sy + dy, color_bits);
-            }
-        }
+        // Visible part of the cell, in map pixels
+        int cx0 = max(px0, cx * 8), cx1 = min(px1, cx * 8 + 8);
+        int cy0 = max(py0, cy * 8), cy1 = min(py1, cy * 8 + 8);
+        int tx = sprite % 16 * 8 + cx0 % 8, ty = sprite / 16 * 8 + cy0 % 8;
+        int dx = sx + cx0 - src_x, dy = sy + cy0 - src_y;
+
+        m_cost.pixels += kernel(m_ram, m_gfx_cache, m_screen, tx, ty, dx, dy, cx1 - cx0, cy1 - cy0);
     }
 }
 
@@ -716,7 +1283,68 @@ void vm::api_mset(int16_t x, int16_t y, uint8_t n)
     if (x < 0 || x >= 128 || y < 0 || y >= 64)
         return;
 
-    m_ram.map[128 * y + x] = n;
+    // The bottom half of the map is shared with the sprite sheet
+    uint8_t &cell = m_ram.map[128 * y + x];
+    cell = n;
+    m_gfx_cache.invalidate(int(&cell - &m_ram[0]), 1);
+}
+
+// Track n = round(v) for v = (c − w·√s) / 2k, as c and s change along
+// an oval, with halfway cases rounded away from zero. Only exact integer
+// midpoint tests are used: |w|·√s stays below 2³² for int16_t ovals, so
+// all the squares fit in 64 bits.
+class oval_dda
+{
+public:
+    oval_dda(int64_t w, int64_t k, int64_t n) : n(n), m_w(w), m_k(k) {}
+
+    int64_t step(int64_t c, uint64_t s)
+    {
+        while (above(c, s, n))
+            ++n;
+        while (!above(c, s, n - 1))
+            --n;
+        return n;
+    }
+
+    int64_t n;
+
+private:
+    // Whether round(v) > n, i.e. w·√s < c − (2n+1)·k, or equality and n ≥ 0
+    bool above(int64_t c, uint64_t s, int64_t n) const
+    {
+        int64_t r = c - (2 * n + 1) * m_k;
+        int cmp = compare(s, r);
+        return cmp < 0 || (cmp == 0 && n >= 0);
+    }
+
+    // The sign of w·√s − r
+    int compare(uint64_t s, int64_t r) const
+    {
+        uint64_t w2s = uint64_t(m_w * m_w) * s;
+        uint64_t abs_r = uint64_t(r < 0 ? -r : r);
+        bool huge = abs_r >> 32 != 0;
+        uint64_t r2 = huge ? 0 : abs_r * abs_r;
+
+        if (m_w >= 0)
+        {
+            if (r < 0)
+                return 1;
+            return huge || w2s < r2 ? -1 : w2s > r2 ? 1 : 0;
+        }
+
+        if (r >= 0)
+            return r > 0 || s ? -1 : 0;
+        return huge || w2s < r2 ? 1 : w2s > r2 ? -1 : 0;
+    }
+
+    int64_t m_w, m_k;
+};
+
+// Round v / 2 up, for any sign of v
+static int ceil_half(int v)
+{
+    return v / 2 + (v > 0 && v % 2 != 0);
 }
 
 void vm::api_oval(int16_t x0, int16_t y0, int16_t x1, int16_t y1, opt<fix32> c)
@@ -735,36 +1363,66 @@ void vm::api_oval(int16_t x0, int16_t y0, int16_t x1, int16_t y1, opt<fix32> c)
     if (y0 > y1)
         std::swap(y0, y1);
 
-    // FIXME: not elegant at all
-    float xc = float(x0 + x1) / 2;
-    float yc = float(y0 + y1) / 2;
+    // Work with the doubled centre (X, Y) and the box size (W, H), which
+    // are all integers; the semi-axes are W/2 and H/2.
+    int X = x0 + x1, Y = y0 + y1;
+    int64_t W = x1 - x0, H = y1 - y0;
+
+    // Flat ovals are lines
+    if (W == 0 || H == 0)
+    {
+        if (H == 0)
+            hline(x0, x1, y0, color_bits);
+        else
+            vline(x0, y0, y1, color_bits);
+        return;
+    }
+
+    // Ovals stay within their bounding box, so they can be rejected at
+    // once if it is not visible.
+    if (clip_box(ds, x0, y0, x1, y1) == box_clip::hidden)
+        return;
 
     auto plot = [&](int16_t x, int16_t y)
     {
         set_pixel(x, y, color_bits);
-        set_pixel(int16_t(2 * xc) - x, y, color_bits);
-        set_pixel(x, int16_t(2 * yc) - y, color_bits);
-        set_pixel(int16_t(2 * xc) - x, int16_t(2 * yc) - y, color_bits);
+        set_pixel(int16_t(X - x), y, color_bits);
+        set_pixel(x, int16_t(Y - y), color_bits);
+        set_pixel(int16_t(X - x), int16_t(Y - y), color_bits);
     };
 
-    // Cutoff for slope = 0.5 happens at x = a²/sqrt(a²+b²)
-    float a = float(x1 - x0) / 2;
-    float b = float(y1 - y0) / 2;
-    float cutoff = a / sqrt(1 + b * b / (a * a));
+    // Whether a column and its mirror image, or a row and its mirror
+    // image, are both clipped; if so, there is no need to plot them.
+    auto hidden = [](int16_t v, int16_t v2, uint8_t lo, uint8_t hi)
+    {
+        return (v < lo || v >= hi) && (v2 < lo || v2 >= hi);
+    };
 
-    for (float dx = 0; dx <= cutoff; ++dx)
+    // Step along x while the slope is below 1, i.e. while the column is
+    // left of x = a²/√(a²+b²), starting from the top of the oval.
+    oval_dda top(H, W, y0);
+    for (int64_t dx = 0; 2 * dx <= W; ++dx)
     {
-        int16_t x = int16_t(ceil(xc + dx));
-        int16_t y = int16_t(round(yc - b / a * sqrt(a * a - dx * dx)));
-        plot(x, y);
+        uint64_t s = uint64_t(W * W - 4 * dx * dx);
+        if (uint64_t(W * W) * s < uint64_t(2 * dx * H) * uint64_t(2 * dx * H))
+            break;
+        int16_t x = int16_t(ceil_half(X) + dx);
+        int16_t y = int16_t(top.step(int64_t(Y) * W, s));
+        if (!hidden(x, int16_t(X - x), ds.clip.x1, ds.clip.x2))
+            plot(x, y);
     }
 
-    cutoff = b / sqrt(1 + a * a / (b * b));
-    for (float dy = 0; dy < cutoff; ++dy)
+    // Then step along y, starting from the left of the oval
+    oval_dda left(W, H, x0);
+    for (int64_t dy = 0; 2 * dy <= H; ++dy)
     {
-        int16_t y = int16_t(ceil(yc + dy));
-        int16_t x = int16_t(round(xc - a / b * sqrt(b * b - dy * dy)));
-        plot(x, y);
+        uint64_t s = uint64_t(H * H - 4 * dy * dy);
+        if (uint64_t(H * H) * s <= uint64_t(2 * dy * W) * uint64_t(2 * dy * W))
+            break;
+        int16_t y = int16_t(ceil_half(Y) + dy);
+        int16_t x = int16_t(left.step(int64_t(X) * H, s));
+        if (!hidden(y, int16_t(Y - y), ds.clip.y1, ds.clip.y2))
+            plot(x, y);
     }
 }
 
@@ -782,21 +1440,36 @@ void vm::api_ovalfill(int16_t x0, int16_t y0, int16_t x1, int16_t y1,
     if (y0 > y1)
         std::swap(y0, y1);
 
-    if (y0 > y1)
-        std::swap(y0, y1);
+    // See api_oval(); W may be negative here, which gives the same spans
+    int X = x0 + x1, Y = y0 + y1;
+    int64_t W = x1 - x0, H = y1 - y0;
 
-    // FIXME: not elegant at all
-    float xc = float(x0 + x1) / 2;
-    float yc = float(y0 + y1) / 2;
+    // Flat ovals are lines
+    if (W == 0 || H == 0)
+    {
+        if (H == 0)
+            hline(x0, x1, y0, color_bits);
+        else
+            vline(x0, y0, y1, color_bits);
+        return;
+    }
 
-    float a = float(x1 - x0) / 2;
-    float b = float(y1 - y0) / 2;
-    for (int16_t y = int16_t(ceil(yc)); y <= y1; ++y)
+    // Start from the bottom row, where the span is a single point, and
+    // move towards the middle row, drawing each row and its mirror image.
+    oval_dda span(W, H, X / 2);
+    for (int y = y1, ymid = ceil_half(Y); y >= ymid; --y)
     {
-        float dy = y - yc;
-        int16_t x = int16_t(round(xc - a / b * sqrt(b * b - dy * dy)));
-        hline(int16_t(2 * xc) - x, x, y, color_bits);
-        hline(int16_t(2 * xc) - x, x, int16_t(2 * yc) - y, color_bits);
+        int64_t d = 2 * y - Y;
+        int16_t x = int16_t(span.step(int64_t(X) * H, uint64_t(H * H - d * d)));
+
+        // Only draw the middle row once
+        int16_t y2 = int16_t(Y - y);
+        bool visible = y >= ds.clip.y1 && y < ds.clip.y2;
+        bool visible2 = y2 != y && y2 >= ds.clip.y1 && y2 < ds.clip.y2;
+        if (visible)
+            hline(int16_t(X - x), x, int16_t(y), color_bits);
+        if (visible2)
+            hline(int16_t(X - x), x, y2, color_bits);
     }
 }
 
@@ -938,11 +1611,15 @@ void vm::api_sset(int16_t x, int16_t y, opt<int16_t> c)
 
     uint8_t col = c ? (uint8_t)*c : ds.pen;
     m_ram.gfx.safe_set(x, y, ds.draw_palette[col & 0xf]);
+    if (x >= 0 && x < 128 && y >= 0 && y < 128)
+        m_gfx_cache.invalidate(64 * y + x / 2, 1);
 }
 
 void vm::api_spr(int16_t n, int16_t x, int16_t y, opt<fix32> w,
                  opt<fix32> h, bool flip_x, bool flip_y)
 {
+    using std::min, std::max;
+
     auto &ds = m_ram.draw_state;
 
     x -= ds.camera.x;
@@ -951,24 +1628,127 @@ void vm::api_spr(int16_t n, int16_t x, int16_t y, opt<fix32> w,
     int16_t w8 = w ? (int16_t)(*w * fix32(8.0)) : 8;
     int16_t h8 = h ? (int16_t)(*h * fix32(8.0)) : 8;
 
-    for (int16_t j = 0; j < h8; ++j)
-        for (int16_t i = 0; i < w8; ++i)
-        {
-            int16_t di = flip_x ? w8 - 1 - i : i;
-            int16_t dj = flip_y ? h8 - 1 - j : j;
-            uint8_t col = m_ram.gfx.safe_get(n % 16 * 8 + di, n / 16 * 8 + dj);
-            if ((ds.draw_palette[col] & 0x10) == 0)
+    // Intersect the destination rectangle with the clipping rectangle
+    int x0 = max(int(x), int(ds.clip.x1)), x1 = min(x + w8, int(ds.clip.x2));
+    int y0 = max(int(y), int(ds.clip.y1)), y1 = min(y + h8, int(ds.clip.y2));
+    if (x0 >= x1 || y0 >= y1)
+        return;
+
+    // Source pixel for the top-left destination pixel, and the source
+    // rectangle bounds
+    int sx = n % 16 * 8 + (flip_x ? w8 - 1 - (x0 - x) : x0 - x);
+    int sy = n / 16 * 8 + (flip_y ? h8 - 1 - (y0 - y) : y0 - y);
+    int sx2 = flip_x ? sx - (x1 - x0 - 1) : sx + (x1 - x0 - 1);
+    int sy2 = flip_y ? sy - (y1 - y0 - 1) : sy + (y1 - y0 - 1);
+
+    m_gfx_cache.update(m_ram.gfx);
+
+    // Sources reaching outside the gfx area are rare enough that they go
+    // through set_pixel(); those pixels read as colour 0.
+    if (min(sx, sx2) < 0 || max(sx, sx2) >= 128 || min(sy, sy2) < 0 || max(sy, sy2) >= 128)
+    {
+        for (int16_t j = y0 - y; j < y1 - y; ++j)
+            for (int16_t i = x0 - x; i < x1 - x; ++i)
             {
-                uint32_t color_bits = (ds.draw_palette[col] & 0xf) << 16;
-                set_pixel(x + i, y + j, color_bits);
+                int16_t di = flip_x ? w8 - 1 - i : i;
+                int16_t dj = flip_y ? h8 - 1 - j : j;
+                int gx = n % 16 * 8 + di, gy = n / 16 * 8 + dj;
+                bool inside = gx >= 0 && gx < 128 && gy >= 0 && gy < 128;
+                uint8_t col = inside ? m_gfx_cache.data[gy][gx] : 0;
+                if ((ds.draw_palette[col] & 0x10) == 0)
+                {
+                    uint32_t color_bits = (ds.draw_palette[col] & 0xf) << 16;
+                    set_pixel(x + i, y + j, color_bits);
+                }
             }
+        return;
+    }
+
+    auto kernel = select_blit_kernel(m_ram, flip_x, flip_y);
+    m_cost.pixels += kernel(m_ram, m_gfx_cache, m_screen, sx, sy, x0, y0, x1 - x0, y1 - y0);
+}
+
+// Compute n * num / den, truncated towards zero like C++ does, as n moves
+// by steps of ±1, without any division. n must not be negative.
+class dda
+{
+public:
+    dda(int num, int den, int n)
+      : m_den(den),
+        m_sign(num < 0 ? -1 : 1),
+        m_qstep(std::abs(num) / den),
+        m_rstep(std::abs(num) % den),
+        m_q(std::abs(num) * n / den),
+        m_r(std::abs(num) * n % den)
+    {}
+
+    int get() const { return m_sign * m_q; }
+
+    void step(bool backwards)
+    {
+        if (backwards)
+        {
+            m_q -= m_qstep;
+            m_r -= m_rstep;
+            if (m_r < 0) { m_r += m_den; --m_q; }
+        }
+        else
+        {
+            m_q += m_qstep;
+            m_r += m_rstep;
+            if (m_r >= m_den) { m_r -= m_den; ++m_q; }
         }
+    }
+
+private:
+    int m_den, m_sign, m_qstep, m_rstep, m_q, m_r;
+};
+
+// sspr() row kernels: draw w pixels starting at screen pixel (x, y), from
+// a source row decoded to one byte per pixel, reading source columns
+// through xs. They are specialised on whether any colour is transparent
+// and on whether a bitplane mask is active, and return the number of
+// pixels drawn.
+template<bool OPAQUE, bool BIT_MASK>
+static int64_t sspr_row_kernel(memory &ram, screen_shadow &screen, uint8_t const *row,
+                               uint8_t const *xs, int x, int y, int w)
+{
+    auto const &pal = ram.draw_state.draw_palette;
+    bit_mask_bits const bm(ram.hw_state.bit_mask);
+    uint8_t *dst = screen.data[y];
+    int64_t pixels = 0;
+    screen.dirty[y] = true;
+
+    for (int i = 0; i < w; ++i)
+    {
+        uint8_t c = pal[row[xs[i]]];
+        if constexpr (!OPAQUE)
+            if (c & 0x10)
+                continue;
+
+        put_pixel<BIT_MASK>(dst, x + i, c & 0xf, bm);
+        ++pixels;
+    }
+
+    return pixels;
 }
 
+using sspr_row_fn = int64_t (*)(memory &, screen_shadow &, uint8_t const *,
+                                uint8_t const *, int, int, int);
+
+// Indexed by opaque | bit_mask << 1
+static constexpr sspr_row_fn sspr_row_kernels[] =
+{
+    &sspr_row_kernel<false, false>, &sspr_row_kernel<true, false>,
+    &sspr_row_kernel<false, true>, &sspr_row_kernel<true, true>,
+};
+
 void vm::api_sspr(int16_t sx, int16_t sy, int16_t sw, int16_t sh,
                   int16_t dx, int16_t dy, opt<int16_t> in_dw,
                   opt<int16_t> in_dh, bool flip_x, bool flip_y)
 {
+    using std::min, std::max;
+
     auto &ds = m_ram.draw_state;
 
     dx -= ds.camera.x;
@@ -980,24 +1760,52 @@ void vm::api_sspr(int16_t sx, int16_t sy, int16_t sw, int16_t sh,
     if (dw < 0) { dw = -dw; dx -= dw - 1; flip_x = !flip_x; }
     if (dh < 0) { dh = -dh; dy -= dh - 1; flip_y = !flip_y; }
 
-    // Iterate over destination pixels
-    // FIXME: maybe clamp if target area is too big?
-    for (int16_t j = 0; j < dh; ++j)
-    for (int16_t i = 0; i < dw; ++i)
+    // Only iterate over destination pixels inside the clipping rectangle
+    int i0 = max(0, ds.clip.x1 - dx), i1 = min(int(dw), ds.clip.x2 - dx);
+    int j0 = max(0, ds.clip.y1 - dy), j1 = min(int(dh), ds.clip.y2 - dy);
+    if (i0 >= i1 || j0 >= j1)
+        return;
+
+    // Source column for each visible destination column. Columns outside
+    // the sprite sheet read as colour 0, like safe_get() does, through an
+    // extra entry at the end of a copy of the source row.
+    std::array<uint8_t, 128> xs;
+    bool outside = false;
+    dda u(sw, dw, flip_x ? dw - 1 - i0 : i0);
+    for (int i = i0; i < i1; ++i, u.step(flip_x))
     {
-        int16_t di = flip_x ? dw - 1 - i : i;
-        int16_t dj = flip_y ? dh - 1 - j : j;
+        int16_t x = int16_t(sx + u.get());
+        xs[i - i0] = x >= 0 && x < 128 ? uint8_t(x) : 128;
+        outside |= xs[i - i0] == 128;
+    }
+
+    static uint8_t const zeroes[129] = { 0 };
+    uint8_t padded[129] = { 0 };
+    int padded_y = -1;
+    m_gfx_cache.update(m_ram.gfx);
 
-        // Find source
-        int16_t x = sx + sw * di / dw;
-        int16_t y = sy + sh * dj / dh;
+    auto row_kernel = sspr_row_kernels[(blit_key(m_ram) >> 3) & 3];
 
-        uint8_t col = m_ram.gfx.safe_get(x, y);
-        if ((ds.draw_palette[col] & 0x10) == 0)
+    dda v(sh, dh, flip_y ? dh - 1 - j0 : j0);
+    for (int j = j0; j < j1; ++j, v.step(flip_y))
+    {
+        int16_t y = int16_t(sy + v.get());
+        uint8_t const *row = zeroes;
+
+        if (y >= 0 && y < 128)
         {
-            uint32_t color_bits = (ds.draw_palette[col] & 0xf) << 16;
-            set_pixel(dx + i, dy + j, color_bits);
+            row = m_gfx_cache.data[y];
+            if (outside)
+            {
+                // Vertical zoom often reads the same row several times
+                if (y != padded_y)
+                    ::memcpy(padded, row, 128);
+                padded_y = y;
+                row = padded;
+            }
         }
+
+        m_cost.pixels += row_kernel(m_ram, m_screen, row, xs.data(), dx + i0, dy + j, i1 - i0);
     }
 }
 
@@ -100,7 +100,8 @@ std::string charset::utf8_to_pico8(std::string const &str)
              && std::regex_search(p, str.end(), sm, utf8_regex)
              && sm.length() > 1)
         {
-            ret += to_pico8[sm.str()];
+            // Use find() because operator[] may insert into the shared map
+            ret += to_pico8.find(sm.str())->second;
             p += sm.length();
         }
         else
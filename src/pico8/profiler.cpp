@@ -0,0 +1,111 @@
+//
+//  ZEPTO-8 — Fantasy console emulator
+//
+//  Copyright © 2016—2021 Sam Hocevar <sam@hocevar.net>
+//
+//  This program is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#if HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <algorithm> // std::replace, std::max
+#include <fstream>   // std::ofstream
+#include <vector>    // std::vector
+
+#include "pico8/profiler.h"
+
+namespace z8::pico8
+{
+
+void profiler::begin_frame()
+{
+    m_last = clock::now();
+    m_next = m_last + period;
+    m_pending.clear();
+    m_native.clear();
+}
+
+void profiler::end_frame()
+{
+    // Charge the end of the frame to the last known stack
+    commit(clock::now());
+}
+
+void profiler::sample(lua_State *l)
+{
+    auto now = clock::now();
+    if (now < m_next)
+        return;
+
+    // Walk the stack from the innermost function outwards
+    std::vector<std::string> frames;
+    lua_Debug ar;
+    for (int level = 0; lua_getstack(l, level, &ar); ++level)
+    {
+        lua_getinfo(l, "Sn", &ar);
+        std::string frame = ar.name ? ar.name : *ar.what == 'm' ? "main" : "?";
+        if (*ar.what != 'C')
+            frame += std::string(" (") + ar.short_src + ":"
+                   + std::to_string(ar.linedefined) + ")";
+        // Semicolons separate frames in the collapsed format
+        std::replace(frame.begin(), frame.end(), ';', ',');
+        frames.push_back(frame);
+    }
+
+    m_stack.clear();
+    for (auto it = frames.rbegin(); it != frames.rend(); ++it)
+        m_stack += (m_stack.empty() ? "" : ";") + *it;
+
+    commit(now);
+    m_next = now + period;
+}
+
+void profiler::commit(clock::time_point now)
+{
+    if (m_stack.empty())
+        m_stack = "?";
+
+    // Split the elapsed time between native calls and Lua code
+    auto elapsed = now - m_last;
+    for (auto const &[f, t] : m_pending)
+    {
+        m_native_stacks[std::make_pair(m_stack, f)] += t;
+        elapsed -= t;
+    }
+    m_stacks[m_stack] += std::max(elapsed, clock::duration::zero());
+
+    m_pending.clear();
+    m_last = now;
+}
+
+bool profiler::save(std::string const &filename,
+                    std::map<lua_CFunction, std::string> const &names) const
+{
+    using std::chrono::duration_cast, std::chrono::microseconds;
+
+    std::ofstream f(filename);
+    if (!f)
+        return false;
+
+    for (auto const &[stack, t] : m_stacks)
+        if (auto us = duration_cast<microseconds>(t).count())
+            f << stack << ' ' << us << '\n';
+
+    for (auto const &[key, t] : m_native_stacks)
+    {
+        auto name = names.find(key.second);
+        if (auto us = duration_cast<microseconds>(t).count())
+            f << key.first << ';' << (name != names.end() ? name->second : "?")
+              << " [native] " << us << '\n';
+    }
+
+    return bool(f);
+}
+
+} // namespace z8::pico8
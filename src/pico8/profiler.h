@@ -0,0 +1,88 @@
+//
+//  ZEPTO-8 — Fantasy console emulator
+//
+//  Copyright © 2016—2021 Sam Hocevar <sam@hocevar.net>
+//
+//  This program is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#pragma once
+
+#include <chrono>   // std::chrono
+#include <map>      // std::map
+#include <string>   // std::string
+#include <utility>  // std::pair
+#include <vector>   // std::vector
+
+#include "3rdparty/z8lua/lua.h"
+
+// The profiler class
+// ——————————————————
+// A sampling profiler for Lua code. The VM calls sample() from its
+// instruction hook; at most one Lua stack is captured per sampling period
+// and is charged for the time elapsed since the previous sample. Native
+// API calls are timed separately and charged to the same stack with the
+// API function as an extra frame.
+
+namespace z8::pico8
+{
+
+class profiler
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    // Frame boundaries; time spent outside frames is not accounted for
+    void begin_frame();
+    void end_frame();
+
+    // Capture the current stack if the sampling period has elapsed
+    void sample(lua_State *l);
+
+    // Time native API calls. Calls may nest when a native function calls
+    // back into Lua; the outer call is paused while the inner one runs, so
+    // that time is only charged once.
+    void enter(lua_CFunction f)
+    {
+        auto now = clock::now();
+        if (!m_native.empty())
+            m_pending[m_native.back().first] += now - m_native.back().second;
+        m_native.emplace_back(f, now);
+    }
+
+    void leave()
+    {
+        if (m_native.empty())
+            return;
+        auto now = clock::now();
+        m_pending[m_native.back().first] += now - m_native.back().second;
+        m_native.pop_back();
+        if (!m_native.empty())
+            m_native.back().second = now;
+    }
+
+    // Write collapsed stacks (one “frame;frame;frame count” line per stack,
+    // with counts in microseconds) for flamegraph.pl or speedscope
+    bool save(std::string const &filename,
+              std::map<lua_CFunction, std::string> const &names) const;
+
+private:
+    void commit(clock::time_point now);
+
+    static constexpr auto period = std::chrono::milliseconds(1);
+
+    clock::time_point m_last, m_next;
+    std::string m_stack;
+
+    std::vector<std::pair<lua_CFunction, clock::time_point>> m_native;
+    std::map<lua_CFunction, clock::duration> m_pending;
+
+    std::map<std::string, clock::duration> m_stacks;
+    std::map<std::pair<std::string, lua_CFunction>, clock::duration> m_native_stacks;
+};
+
+} // namespace z8::pico8
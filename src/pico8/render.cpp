@@ -24,8 +24,9 @@ namespace z8::pico8
 
 void vm::render(lol::u8vec4 *screen) const
 {
-    // Cannot use a 256-value LUT because data access will be
-    // very random due to rotation, flip, stretch etc.
+    // The 32 output colours, indexed like screen palette entries. Screen
+    // memory is up to date here, since step() flushes the screen shadow at
+    // the end of each frame.
     lol::u8vec4 lut[128 + 16];
     for (int c = 0; c < 16; ++c)
     {
@@ -33,6 +34,31 @@ void vm::render(lol::u8vec4 *screen) const
         lut[128 + c] = palette::get8(16 + c);
     }
 
+    // Common case: no screen mode and no raster effect, so that every
+    // screen byte maps to the same two output pixels wherever it is.
+    auto const &ds = m_ram.draw_state;
+    auto const &raster = m_ram.hw_state.raster;
+    if (ds.screen_mode == 0 && raster.mode != 0x10 && (raster.mode & 0x30) != 0x30)
+    {
+        lol::u8vec4 pairs[256][2];
+        for (int b = 0; b < 256; ++b)
+        {
+            pairs[b][0] = lut[ds.screen_palette[b & 0xf]];
+            pairs[b][1] = lut[ds.screen_palette[b >> 4]];
+        }
+
+        for (int y = 0; y < 128; ++y)
+        for (int x = 0; x < 64; ++x)
+        {
+            auto const &p = pairs[m_ram.screen.data[y][x]];
+            *screen++ = p[0];
+            *screen++ = p[1];
+        }
+        return;
+    }
+
+    // Otherwise the colour of a pixel depends on its position (rotation,
+    // flip, stretch, raster effects), so look up each pixel on its own.
     for (int y = 0; y < 128; ++y)
     for (int x = 0; x < 128; ++x)
         *screen++ = lut[m_ram.pixel(x, y)];
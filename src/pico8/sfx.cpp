@@ -221,7 +221,7 @@ void vm::getaudio(int chan, void *in_buffer, int in_bytes)
             }
 
             // Play note
-            float waveform = synth::waveform(sfx.notes[note_id].instrument, phi);
+            float waveform = m_synth.waveform(sfx.notes[note_id].instrument, phi);
 
             // Apply master music volume from fade in/out
             // FIXME: check whether this should be done after distortion
@@ -0,0 +1,258 @@
+//
+//  ZEPTO-8 — Fantasy console emulator
+//
+//  Copyright © 2016—2021 Sam Hocevar <sam@hocevar.net>
+//
+//  This program is free software. It comes without any warranty, to
+//  the extent permitted by applicable law. You can redistribute it
+//  and/or modify it under the terms of the Do What the Fuck You Want
+//  to Public License, Version 2, as published by the WTFPL Task Force.
+//  See http://www.wtfpl.net/ for more details.
+//
+
+#if HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
+#include <algorithm> // std::min, std::max
+
+#include "pico8/vm.h"
+
+namespace z8::pico8
+{
+
+// These used to be implemented in Lua in the BIOS; the code below follows
+// the exact same algorithms so that carts modifying a table while iterating
+// over it see no difference. Tables with a metatable go through the regular
+// metamethod-aware accessors, all others use raw access.
+//
+// We also try to mimic the PICO-8 error messages:
+//  count(nil) → attempt to get length of local 'c' (a nil value)
+//  count("x") → attempt to index local 'c' (a string value)
+//  add("") → attempt to index local 'c' (a string value)
+
+namespace
+{
+
+struct table_ref
+{
+    table_ref(lua_State *state, int index)
+      : l(state), idx(index)
+    {
+        raw = lua_type(l, idx) == LUA_TTABLE && !lua_getmetatable(l, idx);
+        if (lua_type(l, idx) == LUA_TTABLE && !raw)
+            lua_pop(l, 1);
+    }
+
+    int len() const
+    {
+        if (raw)
+            return (int)lua_rawlen(l, idx);
+
+        // Strings and tables with a __len metamethod
+        if (lua_type(l, idx) != LUA_TTABLE && lua_type(l, idx) != LUA_TSTRING)
+            luaL_error(l, "attempt to get length of local 'c' (a %s value)",
+                       luaL_typename(l, idx));
+        lua_len(l, idx);
+        int ret = (int)lua_tointeger(l, -1);
+        lua_pop(l, 1);
+        return ret;
+    }
+
+    // Push c[i]
+    void get(int i) const
+    {
+        if (raw)
+            return lua_rawgeti(l, idx, i);
+
+        check_index();
+        lua_pushinteger(l, i);
+        lua_gettable(l, idx);
+    }
+
+    // Pop a value and store it in c[i]
+    void set(int i) const
+    {
+        if (raw)
+            return lua_rawseti(l, idx, i);
+
+        check_index();
+        lua_pushinteger(l, i);
+        lua_insert(l, -2);
+        lua_settable(l, idx);
+    }
+
+    // Move c[from] to c[to]
+    void move(int from, int to) const
+    {
+        get(from);
+        set(to);
+    }
+
+    void check_index() const
+    {
+        if (lua_type(l, idx) != LUA_TTABLE)
+            luaL_error(l, "attempt to index local 'c' (a %s value)",
+                       luaL_typename(l, idx));
+    }
+
+    lua_State *l;
+    int idx;
+    bool raw;
+};
+
+// PICO-8’s mid() returns the median of its arguments
+int mid(int a, int b, int c)
+{
+    return std::max(std::min(a, b), std::min(std::max(a, b), c));
+}
+
+// Equivalent to i\1 on a PICO-8 number
+int flr(lua_State *l, int idx)
+{
+    return (int)(lua_tonumber(l, idx).bits() >> 16);
+}
+
+} // anonymous namespace
+
+// Count the non-nil elements between c[1] and c[#c], which is slightly
+// different from #c in cases where the table is no longer an array. See
+// the tables.p8 unit test cart for more details.
+int vm::api_count(lua_State *l)
+{
+    table_ref c(l, 1);
+    int cnt = 0, max = c.len();
+
+    for (int i = 1; i <= max; ++i)
+    {
+        c.get(i);
+        cnt += !lua_isnil(l, -1);
+        lua_pop(l, 1);
+    }
+
+    lua_pushinteger(l, cnt);
+    return 1;
+}
+
+// Insert x at i if specified, otherwise append it; return x
+int vm::api_add(lua_State *l)
+{
+    lua_settop(l, 3);
+    if (lua_isnil(l, 1))
+        return 0;
+
+    table_ref c(l, 1);
+    int max = c.len();
+    int i = lua_toboolean(l, 3) ? mid(1, flr(l, 3), max + 1) : max + 1;
+
+    for (int j = max; j >= i; --j)
+        c.move(j, j + 1);
+
+    lua_pushvalue(l, 2);
+    c.set(i);
+
+    lua_pushvalue(l, 2);
+    return 1;
+}
+
+// Remove the first occurrence of v, shifting the following elements
+int vm::api_del(lua_State *l)
+{
+    lua_settop(l, 2);
+    if (lua_isnil(l, 1))
+        return 0;
+
+    table_ref c(l, 1);
+    int max = c.len();
+
+    for (int i = 1; i <= max; ++i)
+    {
+        c.get(i);
+        bool found = lua_compare(l, -1, 2, LUA_OPEQ);
+        lua_pop(l, 1);
+        if (found)
+        {
+            for (int j = i; j <= max; ++j)
+                c.move(j + 1, j);
+            lua_pushvalue(l, 2);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Remove the element at i if specified, otherwise at the end; return it
+int vm::api_deli(lua_State *l)
+{
+    lua_settop(l, 2);
+    if (lua_isnil(l, 1))
+        return 0;
+
+    table_ref c(l, 1);
+    int max = c.len();
+    int i = lua_toboolean(l, 2) ? mid(1, flr(l, 2), max) : max;
+
+    c.get(i);
+    for (int j = i; j <= max; ++j)
+        c.move(j + 1, j);
+
+    return 1;
+}
+
+// Return an iterator over the non-nil elements of c. The current index
+// only advances if the current element did not change, so that deleting
+// it during the iteration does not skip the next one.
+int vm::api_all(lua_State *l)
+{
+    lua_settop(l, 1);
+    if (!lua_isnil(l, 1) && table_ref(l, 1).len() == 0)
+    {
+        lua_pushnil(l);
+        lua_replace(l, 1);
+    }
+
+    lua_pushinteger(l, 1);
+    lua_pushnil(l);
+    lua_pushcclosure(l, &vm::all_iterator, 3);
+    return 1;
+}
+
+int vm::all_iterator(lua_State *l)
+{
+    // Upvalues are the table, the current index and the previous value
+    if (lua_isnil(l, lua_upvalueindex(1)))
+        return 0;
+
+    lua_pushvalue(l, lua_upvalueindex(1));
+    table_ref c(l, lua_gettop(l));
+    int i = (int)lua_tointeger(l, lua_upvalueindex(2));
+
+    // Increment unless the current value changed
+    c.get(i);
+    if (lua_compare(l, -1, lua_upvalueindex(3), LUA_OPEQ))
+        ++i;
+    lua_pop(l, 1);
+
+    // Skip until non-nil or end of table
+    while (i <= c.len())
+    {
+        c.get(i);
+        bool found = !lua_isnil(l, -1);
+        lua_pop(l, 1);
+        if (found)
+            break;
+        ++i;
+    }
+
+    c.get(i);
+
+    lua_pushinteger(l, i);
+    lua_replace(l, lua_upvalueindex(2));
+    lua_pushvalue(l, -1);
+    lua_replace(l, lua_upvalueindex(3));
+    return 1;
+}
+
+} // namespace z8::pico8
+
@@ -18,7 +18,7 @@
 #include <lol/msg>      // lol::msg
 #include <lol/file>     // lol::file
 
-#include <algorithm>  // std::min
+#include <algorithm>  // std::min, std::max
 #include <filesystem>
 #include <chrono>
 #include <ctime>
@@ -27,11 +27,9 @@
 #include "pico8/pico8.h"
 #include "pico8/vm.h"
 #include "bindings/lua.h"
+#include "3rdparty/z8lua/eris.h"
 #include "bios.h"
 
-// FIXME: activate this one day, when we use Lua 5.3 maybe?
-#define HAVE_LUA_GETEXTRASPACE 0
-
 // Binding specialisations specific to PICO-8
 template<> void z8::bindings::lua_get(lua_State *l, int n,
                                       z8::pico8::rich_string &arg)
@@ -69,17 +67,28 @@ namespace z8::pico8
 
 vm::vm()
 {
-    m_bios = std::make_unique<bios>();
+    m_bios = &bios::get();
 
-    m_lua = luaL_newstate();
+    // Use this as the allocator userdata so that hooks can retrieve it
+    m_lua = lua_newstate([](void *ud, void *ptr, size_t osize, size_t nsize)
+    {
+        return heap::alloc(&((vm *)ud)->m_heap, ptr, osize, nsize);
+    }, this);
     lua_atpanic(m_lua, &vm::panic_hook);
+    // The @, % and $ operators read memory directly, so unlike peek() they
+    // see screen memory as it was at the last screen shadow flush.
     lua_setpico8memory(m_lua, (uint8_t *)&m_ram);
     luaL_openlibs(m_lua);
 
     bindings::lua::init(m_lua, this);
 
-    // Automatically yield every 1000 instructions
-    lua_sethook(m_lua, &vm::instruction_hook, LUA_MASKCOUNT, 1000);
+    // Iterators returned by all() are C closures over this function; the
+    // BIOS makes it an eris permanent, see __z8_perms()
+    lua_pushcfunction(m_lua, &vm::all_iterator);
+    lua_setglobal(m_lua, "__all_iterator");
+
+    // Count instructions and yield when the CPU budget is exhausted
+    lua_sethook(m_lua, &vm::instruction_hook, LUA_MASKCOUNT, m_hook_period);
 
     // Clear memory
     ::memset(&m_ram, 0, sizeof(m_ram));
@@ -88,8 +97,11 @@ vm::vm()
     auto now = std::chrono::high_resolution_clock::now();
     api_srand(fix32::frombits((int32_t)now.time_since_epoch().count()));
 
-    // Initialize Zepto8 runtime
-    int status = luaL_dostring(m_lua, m_bios->get_code().c_str());
+    // Initialize Zepto8 runtime from the precompiled BIOS
+    auto const &bytecode = m_bios->get_bytecode();
+    int status = luaL_loadbuffer(m_lua, bytecode.data(), bytecode.size(), "bios.p8");
+    if (status == LUA_OK)
+        status = lua_pcall(m_lua, 0, LUA_MULTRET, 0);
     if (status != LUA_OK)
     {
         char const *message = lua_tostring(m_lua, -1);
@@ -97,6 +109,14 @@ vm::vm()
         lua_pop(m_lua, 1);
         assert(false);
     }
+
+    // Only account for memory allocated by the cart from now on
+    m_heap_base = m_heap.used();
+    m_heap.set_limit(m_heap_base + lua_memory_limit);
+
+    // The GC is driven by step(), between frames
+    lua_gc(m_lua, LUA_GCSTOP, 0);
+    m_gc_threshold = m_heap.used() + gc_min_growth;
 }
 
 vm::~vm()
@@ -106,7 +126,7 @@ vm::~vm()
 
 std::string const &vm::get_code() const
 {
-    return m_cart.get_code();
+    return m_cart->get_code();
 }
 
 u4mat2<128, 128> const &vm::get_screen() const
@@ -116,12 +136,17 @@ u4mat2<128, 128> const &vm::get_screen() const
 
 std::tuple<uint8_t *, size_t> vm::ram()
 {
+    // The caller may read anything, and write anywhere until the next
+    // step(), which reloads the screen shadow.
+    m_screen.flush(m_ram.screen);
+    m_screen_stale = true;
+    m_gfx_cache.invalidate(0, sizeof(m_ram));
     return std::make_tuple(&m_ram[0], sizeof(m_ram));
 }
 
 std::tuple<uint8_t *, size_t> vm::rom()
 {
-    auto rom = m_cart.get_rom();
+    auto &rom = m_cart->get_rom();
     return std::make_tuple(&rom[0], sizeof(rom));
 }
 
@@ -141,20 +166,26 @@ int vm::panic_hook(lua_State* l)
 
 void vm::instruction_hook(lua_State *l, lua_Debug *)
 {
-#if HAVE_LUA_GETEXTRASPACE
-    vm *that = *static_cast<vm**>(lua_getextraspace(l));
-#else
-    lua_getglobal(l, "\x01");
-    vm *that = (vm *)lua_touserdata(l, -1);
-    lua_remove(l, -1);
-#endif
-
-    // The value 135000 was found using trial and error, but it causes
-    // side effects in lots of cases. Use 300000 instead.
-    // FIXME: this is because we do not consider system costs, see
-    // https://pico-8.fandom.com/wiki/CPU for more information
-    that->m_instructions += 1000;
-    if (that->m_instructions >= 300000)
+    // The allocator userdata is the VM itself
+    vm *that = nullptr;
+    lua_getallocf(l, (void **)&that);
+
+    that->m_cost.instructions += that->m_hook_period;
+
+    if (that->m_profiler)
+        that->m_profiler->sample(l);
+
+    // The collector is normally stopped and driven by step(); let it run
+    // again when the cart gets close to the memory limit, so that Lua can
+    // perform emergency collections instead of failing allocations.
+    if (that->m_heap.used() > that->m_heap_base + lua_memory_limit * 3 / 4)
+        lua_gc(l, LUA_GCRESTART, 0);
+
+    // PICO-8 does not interrupt slow frames, it just skips the next ones,
+    // but we need to give control back to the host at some point. Yielding
+    // at 100% CPU shows half-drawn frames in too many carts, so the default
+    // budget allows some margin before doing so.
+    if (that->m_cost.total() >= that->m_cpu_budget)
         lua_yield(l, 0);
 }
 
@@ -235,7 +266,8 @@ tup<bool, bool, std::string> vm::private_download(opt<std::string> str)
             return std::make_tuple(true, false, "can't save cart file");
 
         // Load cart
-        m_cart.load(download_state.cart_path);
+        m_cart = std::make_shared<cart>();
+        m_cart->load(download_state.cart_path);
         return std::make_tuple(true, true, std::string());
     default:
         break;
@@ -251,9 +283,11 @@ bool vm::private_load(std::string name)
     return true;
 }
 
-void vm::load(std::string const &name)
+bool vm::load(std::string const &name)
 {
-    m_cart.load(name);
+    // Do not modify the current cart, clones may be sharing it
+    m_cart = std::make_shared<cart>();
+    return m_cart->load(name);
 }
 
 void vm::run()
@@ -268,8 +302,20 @@ void vm::run()
     }
 }
 
-bool vm::step(float /* seconds */)
+bool vm::step(float seconds)
 {
+    lol::timer t;
+    m_cost = cpu_cost();
+
+    if (m_profiler)
+        m_profiler->begin_frame();
+
+    if (m_screen_stale)
+    {
+        memory_written(offsetof(memory, screen), sizeof(m_ram.screen));
+        m_screen_stale = false;
+    }
+
     bool ret = false;
     lua_getglobal(m_lua, "__z8_tick");
     int status = lua_pcall(m_lua, 0, 1, 0);
@@ -284,10 +330,193 @@ bool vm::step(float /* seconds */)
     }
     lua_pop(m_lua, 1);
 
-    m_instructions = 0;
+    // Whether the frame is over or was interrupted, leave screen memory
+    // up to date for render(), get_screen() and snapshots.
+    m_screen.flush(m_ram.screen);
+
+    m_cpu_usage = float(m_cost.total()) / cpu_cost::cycles_per_frame;
+
+    if (m_profiler)
+        m_profiler->end_frame();
+
+    // Spend what is left of the frame on garbage collection
+    collect_garbage(seconds - t.poll());
+
     return ret;
 }
 
+void vm::collect_garbage(float budget)
+{
+    lol::timer t;
+    m_gc_time = 0.f;
+
+    // Undo any emergency restart from instruction_hook()
+    lua_gc(m_lua, LUA_GCSTOP, 0);
+
+    // Only start a new cycle once the heap has grown enough since the end
+    // of the previous one, then run incremental steps until the cycle is
+    // over or the frame budget is exhausted.
+    if (!m_gc_pending && m_heap.used() < m_gc_threshold)
+        return;
+
+    m_gc_pending = true;
+    do
+    {
+        if (lua_gc(m_lua, LUA_GCSTEP, 0))
+        {
+            // Never wait past half the memory limit, so that the next cycle
+            // starts here rather than in the emergency restart triggered
+            // from instruction_hook() in the middle of a frame.
+            m_gc_pending = false;
+            m_gc_threshold = std::min(std::max(m_heap.used() * 2, m_heap.used() + gc_min_growth),
+                                      m_heap_base + lua_memory_limit / 2);
+            break;
+        }
+    }
+    while (t.poll() < budget);
+
+    m_gc_time = t.get();
+}
+
+//
+// Snapshots
+//
+
+// Push the eris permanents table used for persisting (objects to ids) or
+// unpersisting (ids to objects). Both are built once and kept in the
+// registry, since the BIOS API never changes.
+void vm::push_perms(bool persist)
+{
+    if (m_perms == LUA_NOREF)
+    {
+        lua_getglobal(m_lua, "__z8_perms");
+        lua_call(m_lua, 0, 2);
+        m_unperms = luaL_ref(m_lua, LUA_REGISTRYINDEX);
+        m_perms = luaL_ref(m_lua, LUA_REGISTRYINDEX);
+    }
+
+    lua_rawgeti(m_lua, LUA_REGISTRYINDEX, persist ? m_perms : m_unperms);
+}
+
+bool vm::save(snapshot &s)
+{
+    // Persist the main loop coroutine. This captures the cart sandbox and
+    // everything reachable from it; BIOS functions are only referenced.
+    // The GC must not run while eris walks the object graph, and the
+    // memory limit does not apply to the serialised data.
+    m_heap.set_limit(SIZE_MAX);
+    bool gc_running = lua_gc(m_lua, LUA_GCISRUNNING, 0);
+    lua_gc(m_lua, LUA_GCSTOP, 0);
+    lua_pushcfunction(m_lua, [](lua_State *l) -> int { eris_persist(l, 1, 2); return 1; });
+    push_perms(true);
+    lua_getglobal(m_lua, "__z8_loop");
+    int status = lua_pcall(m_lua, 2, 1, 0);
+    if (gc_running)
+        lua_gc(m_lua, LUA_GCRESTART, 0);
+
+    if (status == LUA_OK)
+    {
+        size_t len;
+        char const *data = lua_tolstring(m_lua, -1, &len);
+        s.lua.assign(data, len);
+    }
+    else
+    {
+        char const *message = lua_tostring(m_lua, -1);
+        lol::msg::error("error %d saving snapshot: %s\n", status, message);
+    }
+    lua_pop(m_lua, 1);
+    m_heap.set_limit(m_heap_base + lua_memory_limit);
+
+    if (status != LUA_OK)
+        return false;
+
+    m_screen.flush(m_ram.screen);
+    ::memcpy(&s.ram, &m_ram, sizeof(m_ram));
+    s.st = m_state;
+    s.rom = m_cart;
+    s.cartdata = m_cartdata;
+    return true;
+}
+
+bool vm::restore(snapshot const &s)
+{
+    m_heap.set_limit(SIZE_MAX);
+    bool gc_running = lua_gc(m_lua, LUA_GCISRUNNING, 0);
+    lua_gc(m_lua, LUA_GCSTOP, 0);
+    lua_pushcfunction(m_lua, [](lua_State *l) -> int { eris_unpersist(l, 1, 2); return 1; });
+    push_perms(false);
+    lua_pushlstring(m_lua, s.lua.data(), s.lua.size());
+    int status = lua_pcall(m_lua, 2, 1, 0);
+    if (gc_running)
+        lua_gc(m_lua, LUA_GCRESTART, 0);
+
+    if (status == LUA_OK)
+    {
+        lua_setglobal(m_lua, "__z8_loop");
+    }
+    else
+    {
+        char const *message = lua_tostring(m_lua, -1);
+        lol::msg::error("error %d restoring snapshot: %s\n", status, message);
+        lua_pop(m_lua, 1);
+    }
+    m_heap.set_limit(m_heap_base + lua_memory_limit);
+
+    if (status != LUA_OK)
+        return false;
+
+    ::memcpy(&m_ram, &s.ram, sizeof(m_ram));
+    memory_written(0, sizeof(m_ram));
+    m_state = s.st;
+    m_cart = s.rom;
+    m_cartdata = s.cartdata;
+    return true;
+}
+
+std::unique_ptr<vm_base> vm::clone()
+{
+    snapshot s;
+    if (!save(s))
+        return nullptr;
+
+    auto ret = std::make_unique<vm>();
+    ret->set_cpu_budget(float(m_cpu_budget) / cpu_cost::cycles_per_frame, m_hook_period);
+    if (!ret->restore(s))
+        return nullptr;
+
+    return ret;
+}
+
+void vm::set_cpu_budget(float frames, int period)
+{
+    m_cpu_budget = int64_t(frames * cpu_cost::cycles_per_frame);
+    m_hook_period = std::max(1, period);
+    lua_sethook(m_lua, &vm::instruction_hook, LUA_MASKCOUNT, m_hook_period);
+}
+
+//
+// Profiling
+//
+
+void vm::enable_profiler()
+{
+    m_profiler = std::make_unique<profiler>();
+}
+
+bool vm::save_profile(std::string const &filename) const
+{
+    if (!m_profiler)
+        return false;
+
+    // Map the native functions back to their API names
+    std::map<lua_CFunction, std::string> names;
+    for (auto const &desc : exported_api<bindings::lua>().data)
+        names[desc.func] = desc.name;
+
+    return m_profiler->save(filename, names);
+}
+
 void vm::button(int index, int state)
 {
     m_state.buttons[1][index] += state;
@@ -327,7 +556,7 @@ void vm::api_run()
 
     // Load cartridge code and call __z8_run_cart() on it
     lua_getglobal(m_sandbox_lua, "__z8_run_cart");
-    lua_pushstring(m_sandbox_lua, m_cart.get_code().c_str());
+    lua_pushstring(m_sandbox_lua, m_cart->get_code().c_str());
     lua_pcall(m_sandbox_lua, 1, 0, 0);
 }
 
@@ -361,6 +590,9 @@ void vm::api_reload(int16_t in_dst, int16_t in_src, opt<int16_t> in_size)
         return;
     }
 
+    flush_screen(dst, size);
+    int written_dst = dst, written_size = size;
+
     // If reading from after the cart, fill that part with zeroes
     if (src > (int)offsetof(memory, code))
     {
@@ -371,54 +603,70 @@ void vm::api_reload(int16_t in_dst, int16_t in_src, opt<int16_t> in_size)
         size -= amount;
     }
 
+    m_cost.bytes += size;
+
     // Now copy possibly legal data
     int amount = min(size, (int)offsetof(memory, code) - src);
-    ::memcpy(&m_ram[dst], &m_cart.get_rom()[src], amount);
+    ::memcpy(&m_ram[dst], &m_cart->get_rom()[src], amount);
     dst += amount;
     size -= amount;
 
     // If there is anything left to copy, it’s zeroes again
     ::memset(&m_ram[dst], 0, size);
 
+    memory_written(written_dst, written_size);
     update_registers();
 }
 
 fix32 vm::api_dget(int16_t n)
 {
     // FIXME: cannot be used before cartdata()
-    return n >= 0 && n < 64 ? api_peek4(0x5e00 + 4 * n, 1)[0] : fix32(0);
+    if (n < 0 || n >= 64)
+        return fix32(0);
+
+    uint8_t const *p = &m_ram.persistent[4 * n];
+    return fix32::frombits(int32_t(p[0] | p[1] << 8 | p[2] << 16 | uint32_t(p[3]) << 24));
 }
 
 void vm::api_dset(int16_t n, fix32 x)
 {
     // FIXME: cannot be used before cartdata()
-    if (n >= 0 && n < 64)
-        api_poke4(0x5e00 + 4 * n, std::vector<fix32> { x });
+    if (n < 0 || n >= 64)
+        return;
+
+    uint8_t *p = &m_ram.persistent[4 * n];
+    uint32_t bits = (uint32_t)x.bits();
+    p[0] = (uint8_t)bits;
+    p[1] = (uint8_t)(bits >> 8);
+    p[2] = (uint8_t)(bits >> 16);
+    p[3] = (uint8_t)(bits >> 24);
 }
 
-std::vector<int16_t> vm::api_peek(int16_t addr, opt<int16_t> count)
+stack_writer<int16_t> vm::api_peek(int16_t addr, opt<int16_t> count)
 {
-    std::vector<int16_t> ret;
     // Note: peek() is the same as peek(0)
-    size_t n = count ? std::max(0, std::min(int(*count), 8192)) : 1;
+    int n = count ? std::max(0, std::min(int(*count), 8192)) : 1;
+    stack_writer<int16_t> ret(m_sandbox_lua, n);
+    flush_screen(addr, n);
 
-    for ( ; ret.size() < n; ++addr)
+    for ( ; ret.count < n; ++addr)
     {
         int16_t bits = 0;
         if (addr >= 0 && (int)(addr + n) < (int)sizeof(m_ram))
             bits = m_ram[addr];
-        ret.push_back(bits);
+        ret.push(bits);
     }
 
     return ret;
 }
 
-std::vector<int16_t> vm::api_peek2(int16_t addr, opt<int16_t> count)
+stack_writer<int16_t> vm::api_peek2(int16_t addr, opt<int16_t> count)
 {
-    std::vector<int16_t> ret;
-    size_t n = count ? std::max(0, std::min(int(*count), 8192)) : 1;
+    int n = count ? std::max(0, std::min(int(*count), 8192)) : 1;
+    stack_writer<int16_t> ret(m_sandbox_lua, n);
+    flush_screen(addr, 2 * n);
 
-    for ( ; ret.size() < n; addr += 2)
+    for ( ; ret.count < n; addr += 2)
     {
         int16_t bits = 0;
         for (int i = 0; i < 2; ++i)
@@ -429,18 +677,19 @@ std::vector<int16_t> vm::api_peek2(int16_t addr, opt<int16_t> count)
             else if (addr + i >= (int)sizeof(m_ram))
                 bits |= m_ram[addr + i - (int)sizeof(m_ram)] << (8 * i);
         }
-        ret.push_back(bits);
+        ret.push(bits);
     }
 
     return ret;
 }
 
-std::vector<fix32> vm::api_peek4(int16_t addr, opt<int16_t> count)
+stack_writer<fix32> vm::api_peek4(int16_t addr, opt<int16_t> count)
 {
-    std::vector<fix32> ret;
-    size_t n = count ? std::max(0, std::min(int(*count), 8192)) : 1;
+    int n = count ? std::max(0, std::min(int(*count), 8192)) : 1;
+    stack_writer<fix32> ret(m_sandbox_lua, n);
+    flush_screen(addr, 4 * n);
 
-    for ( ; ret.size() < n; addr += 4)
+    for ( ; ret.count < n; addr += 4)
     {
         int32_t bits = 0;
         for (int i = 0; i < 4; ++i)
@@ -451,72 +700,76 @@ std::vector<fix32> vm::api_peek4(int16_t addr, opt<int16_t> count)
             else if (addr + i >= (int)sizeof(m_ram))
                 bits |= m_ram[addr + i - (int)sizeof(m_ram)] << (8 * i);
         }
-        ret.push_back(fix32::frombits(bits));
+        ret.push(fix32::frombits(bits));
     }
 
     return ret;
 }
 
-void vm::api_poke(int16_t addr, std::vector<int16_t> args)
+void vm::api_poke(int16_t addr, stack_view<int16_t> args)
 {
     // Note: poke() is the same as poke(0, 0)
-    if (args.empty())
-        args.push_back(0);
+    int n = std::max(1, (int)args.size());
 
-    if (addr < 0 || addr + args.size() > sizeof(m_ram) - 1)
+    if (addr < 0 || addr + n > (int)sizeof(m_ram) - 1)
     {
         runtime_error("bad memory access");
         return;
     }
 
-    for (auto val : args)
-        m_ram[addr++] = (uint8_t)val;
+    flush_screen(addr, n);
+    for (int i = 0; i < n; ++i)
+        m_ram[addr + i] = args.empty() ? 0 : (uint8_t)args[i];
 
+    memory_written(addr, n);
     update_registers();
 }
 
-void vm::api_poke2(int16_t addr, std::vector<int16_t> args)
+void vm::api_poke2(int16_t addr, stack_view<int16_t> args)
 {
     // Note: poke2() is the same as poke2(0, 0)
-    if (args.empty())
-        args.push_back(0);
+    int n = std::max(1, (int)args.size());
 
-    if (addr < 0 || addr + 2 * args.size() > sizeof(m_ram) - 2)
+    if (addr < 0 || addr + 2 * n > (int)sizeof(m_ram) - 2)
     {
         runtime_error("bad memory access");
         return;
     }
 
-    for (auto val : args)
+    flush_screen(addr, 2 * n);
+    for (int i = 0; i < n; ++i)
     {
-        m_ram[addr++] = (uint8_t)val;
-        m_ram[addr++] = (uint8_t)((uint16_t)val >> 8);
+        int16_t val = args.empty() ? 0 : args[i];
+        m_ram[addr + 2 * i] = (uint8_t)val;
+        m_ram[addr + 2 * i + 1] = (uint8_t)((uint16_t)val >> 8);
     }
 
+    memory_written(addr, 2 * n);
     update_registers();
 }
 
-void vm::api_poke4(int16_t addr, std::vector<fix32> args)
+void vm::api_poke4(int16_t addr, stack_view<fix32> args)
 {
     // Note: poke4() is the same as poke4(0, 0)
-    if (args.empty())
-        args.push_back(fix32(0));
+    int n = std::max(1, (int)args.size());
 
-    if (addr < 0 || addr + 4 * args.size() > sizeof(m_ram) - 4)
+    if (addr < 0 || addr + 4 * n > (int)sizeof(m_ram) - 4)
     {
         runtime_error("bad memory access");
         return;
     }
 
-    for (auto val : args)
+    flush_screen(addr, 4 * n);
+    for (int i = 0; i < n; ++i)
     {
-        uint32_t x = (uint32_t)val.bits();
-        m_ram[addr++] = (uint8_t)x;
-        m_ram[addr++] = (uint8_t)(x >> 8);
-        m_ram[addr++] = (uint8_t)(x >> 16);
-        m_ram[addr++] = (uint8_t)(x >> 24);
+        uint32_t x = args.empty() ? 0 : (uint32_t)args[i].bits();
+        m_ram[addr + 4 * i] = (uint8_t)x;
+        m_ram[addr + 4 * i + 1] = (uint8_t)(x >> 8);
+        m_ram[addr + 4 * i + 2] = (uint8_t)(x >> 16);
+        m_ram[addr + 4 * i + 3] = (uint8_t)(x >> 24);
     }
 
+    memory_written(addr, 4 * n);
     update_registers();
 }
 
@@ -541,6 +794,11 @@ void vm::api_memcpy(int16_t in_dst, int16_t in_src, int16_t in_size)
         return;
     }
 
+    m_cost.bytes += size;
+    flush_screen(src, size);
+    flush_screen(dst, size);
+    int written_dst = dst, written_size = size;
+
     // If source is outside main memory, part of the operation will be
     // memset(0). But we delay the operation in case the source and the
     // destination overlap.
@@ -566,6 +824,7 @@ void vm::api_memcpy(int16_t in_dst, int16_t in_src, int16_t in_size)
     if (size)
         ::memset(&m_ram[dst], 0, size);
 
+    memory_written(written_dst, written_size);
     update_registers();
 }
 
@@ -581,11 +840,35 @@ void vm::api_memset(int16_t dst, uint8_t val, int16_t size)
         return;
     }
 
+    flush_screen(dst, size);
     ::memset(&m_ram[dst], val, size);
+    m_cost.bytes += size;
+    memory_written(dst, size);
 
     update_registers();
 }
 
+void vm::flush_screen(int addr, int size)
+{
+    int const screen = offsetof(memory, screen);
+    if (addr < screen + (int)sizeof(m_ram.screen) && addr + size > screen)
+        m_screen.flush(m_ram.screen);
+}
+
+void vm::memory_written(int addr, int size)
+{
+    int const screen = offsetof(memory, screen);
+    m_gfx_cache.invalidate(addr, size);
+    if (addr < screen + (int)sizeof(m_ram.screen) && addr + size > screen)
+        m_screen.load(m_ram.screen, addr - screen, size);
+
+    // Drawing functions write to the screen shadow without bounds checks,
+    // so keep the clipping rectangle inside the screen.
+    auto &clip = m_ram.draw_state.clip;
+    clip.x2 = std::min(clip.x2, uint8_t(128));
+    clip.y2 = std::min(clip.y2, uint8_t(128));
+}
+
 void vm::update_registers()
 {
     // PICO-8 appears to update this after a poke(). No bits are set to 1 though.
@@ -639,18 +922,18 @@ var<bool, int16_t, fix32, std::string, std::nullptr_t> vm::api_stat(int16_t id)
 
     if (id == 0)
     {
-        // Perform a GC to avoid accounting for short lifespan objects.
-        // Not sure about the performance cost of this.
-        lua_gc(m_sandbox_lua, LUA_GCCOLLECT, 0);
-
-        // From the PICO-8 documentation:
-        int32_t bits = ((int)lua_gc(m_sandbox_lua, LUA_GCCOUNT, 0) << 16)
-                     + ((int)lua_gc(m_sandbox_lua, LUA_GCCOUNTB, 0) << 6);
-        return fix32::frombits(bits);
+        // Memory allocated since the BIOS was loaded, in KiB; this includes
+        // garbage that has not been collected yet.
+        size_t used = m_heap.used() - std::min(m_heap.used(), m_heap_base);
+        return fix32::frombits(int32_t(used << 6));
     }
 
     if (id == 1 || id == 2)
-        return int16_t(0); // TODO (CPU usage)
+    {
+        // CPU used since the last frame, in 1/30th of a second
+        int64_t cycles = id == 1 ? m_cost.total() : m_cost.system();
+        return fix32::frombits(int32_t((cycles << 16) / cpu_cost::cycles_per_frame));
+    }
 
     if (id == 4)
         return std::string(); // TODO (clipboard)
@@ -724,9 +1007,16 @@ var<bool, int16_t, fix32, std::string, std::nullptr_t> vm::api_stat(int16_t id)
 
     if ((id >= 80 && id <= 85) || (id >= 90 && id <= 95))
     {
+        // Use the reentrant variants; std::gmtime() and std::localtime()
+        // return a pointer to shared static storage.
         time_t t;
         time(&t);
-        auto const *tm = (id <= 85 ? std::gmtime : std::localtime)(&t);
+        std::tm tmbuf, *tm = &tmbuf;
+#if _WIN32
+        (id <= 85 ? gmtime_s : localtime_s)(tm, &t);
+#else
+        (id <= 85 ? gmtime_r : localtime_r)(&t, tm);
+#endif
         switch (id % 10)
         {
             case 0: return int16_t(tm->tm_year + 1900);
@@ -14,6 +14,9 @@
 
 #include <lol/engine.h> // lol::net
 
+#include <array>
+#include <bitset>
+#include <memory>
 #include <optional>
 #include <variant>
 
@@ -21,7 +24,12 @@
 #include "bios.h"
 #include "pico8/cart.h"
 #include "pico8/memory.h"
+#include "pico8/profiler.h"
+#include "synth.h"
+#include "heap.h"
+#include "bindings/stack.h"
 #include "3rdparty/z8lua/lua.h"
+#include "3rdparty/z8lua/lauxlib.h"
 
 namespace z8 { class player; }
 
@@ -31,6 +39,8 @@ namespace z8::pico8
 template<typename T> using opt = std::optional<T>;
 template<typename... T> using var = std::variant<T...>;
 template<typename... T> using tup = std::tuple<T...>;
+using bindings::stack_view;
+using bindings::stack_writer;
 
 struct rich_string : public std::string {};
 
@@ -71,6 +81,72 @@ struct state
     channels[4];
 };
 
+// A snapshot of everything needed to resume a VM: memory, VM state, the
+// cart it was started from, and the Lua main loop coroutine persisted
+// with eris.
+struct snapshot
+{
+    memory ram;
+    state st;
+    std::shared_ptr<cart> rom;
+    std::string cartdata;
+    std::string lua;
+};
+
+// A rough model of the PICO-8 CPU, which runs 8M virtual cycles per
+// second. Lua instructions cost about 2 cycles each; drawing and memory
+// functions are charged by the amount of pixels and bytes they touch.
+// See https://pico-8.fandom.com/wiki/CPU for more information.
+struct cpu_cost
+{
+    static int64_t constexpr cycles_per_frame = 8'000'000 / 30;
+
+    int64_t instructions = 0;
+    int64_t pixels = 0;
+    int64_t bytes = 0;
+
+    int64_t lua() const { return instructions * 2; }
+    int64_t system() const { return pixels / 8 + bytes / 4; }
+    int64_t total() const { return lua() + system(); }
+};
+
+// A copy of the sprite sheet (0x0000—0x1fff) with one byte per pixel, so
+// that blitters do not need to unpack nibbles. Writes to that memory mark
+// the sprites they touch as dirty, and update() decodes them again.
+struct gfx_cache
+{
+    gfx_cache() { dirty.set(); }
+
+    // Mark the sprites overlapping memory [addr, addr + size) as dirty
+    void invalidate(int addr, int size);
+
+    // Decode the dirty sprites from the packed sprite sheet
+    void update(u4mat2<128, 128> const &gfx);
+
+    uint8_t data[128][128];
+    std::bitset<256> dirty;
+};
+
+// A copy of the screen (0x6000—0x7fff) with one byte per pixel, which the
+// drawing functions write to instead of screen memory. The rows they
+// change are marked as dirty, and flush() packs them back to memory when
+// something is about to observe it.
+struct screen_shadow
+{
+    // Pack the dirty rows back to screen memory
+    void flush(u4mat2<128, 128> &screen);
+
+    // Unpack the rows overlapping bytes [offset, offset + size) of screen
+    // memory after they were written to; they must have been flushed first.
+    void load(u4mat2<128, 128> const &screen, int offset, int size);
+
+    uint8_t data[128][128] = {};
+
+    // One flag per row rather than a bitset, so that marking a row in the
+    // middle of a drawing loop is a plain store
+    std::array<bool, 128> dirty = {};
+};
+
 class vm : z8::vm_base
 {
     friend class z8::player;
@@ -79,7 +155,7 @@ public:
     vm();
     virtual ~vm();
 
-    virtual void load(std::string const &name);
+    virtual bool load(std::string const &name);
     virtual void run();
     virtual bool step(float seconds);
 
@@ -95,9 +171,31 @@ public:
     virtual void mouse(lol::ivec2 coords, int buttons);
     virtual void text(char ch);
 
+    // Writes through the returned pointer are only seen by the sprite
+    // cache and the screen if ram() is called again before the next step().
     virtual std::tuple<uint8_t *, size_t> ram();
     virtual std::tuple<uint8_t *, size_t> rom();
 
+    virtual float get_gc_time() const { return m_gc_time; }
+    virtual float get_cpu_usage() const { return m_cpu_usage; }
+
+    // Emulated costs (instructions, pixels, bytes) of the last step()
+    cpu_cost const &get_cost() const { return m_cost; }
+
+    // Snapshots; a snapshot can be restored into any pico8::vm from the
+    // same process. They should be taken between two calls to step().
+    bool save(snapshot &s);
+    bool restore(snapshot const &s);
+    virtual std::unique_ptr<vm_base> clone();
+
+    // Interrupt the cart once it has used this many frames worth of CPU
+    // in a single step(), checking every given number of Lua instructions
+    void set_cpu_budget(float frames, int period = 1000);
+
+    // Sample Lua stacks and native calls, and save them as collapsed stacks
+    void enable_profiler();
+    bool save_profile(std::string const &filename) const;
+
 private:
     void runtime_error(std::string str);
     static int panic_hook(struct lua_State *l);
@@ -125,12 +223,12 @@ private:
     void api_reload(int16_t in_dst, int16_t in_src, opt<int16_t> in_size);
     fix32 api_dget(int16_t addr);
     void api_dset(int16_t addr, fix32 val);
-    std::vector<int16_t> api_peek(int16_t addr, opt<int16_t> count);
-    std::vector<int16_t> api_peek2(int16_t addr, opt<int16_t> count);
-    std::vector<fix32> api_peek4(int16_t addr, opt<int16_t> count);
-    void api_poke(int16_t addr, std::vector<int16_t> args);
-    void api_poke2(int16_t addr, std::vector<int16_t> args);
-    void api_poke4(int16_t addr, std::vector<fix32> args);
+    stack_writer<int16_t> api_peek(int16_t addr, opt<int16_t> count);
+    stack_writer<int16_t> api_peek2(int16_t addr, opt<int16_t> count);
+    stack_writer<fix32> api_peek4(int16_t addr, opt<int16_t> count);
+    void api_poke(int16_t addr, stack_view<int16_t> args);
+    void api_poke2(int16_t addr, stack_view<int16_t> args);
+    void api_poke4(int16_t addr, stack_view<fix32> args);
     void api_memcpy(int16_t dst, int16_t src, int16_t size);
     void api_memset(int16_t dst, uint8_t val, int16_t size);
     fix32 api_rnd(opt<fix32>);
@@ -139,6 +237,14 @@ private:
     void api_printh(rich_string str, opt<std::string> filename, opt<bool> overwrite);
     void api_extcmd(std::string cmd);
 
+    // Tables; these take the Lua state because they handle arbitrary values
+    int api_count(lua_State *l);
+    int api_add(lua_State *l);
+    int api_del(lua_State *l);
+    int api_deli(lua_State *l);
+    int api_all(lua_State *l);
+    static int all_iterator(lua_State *l);
+
     // I/O
     void api_update_buttons();
     var<bool, int16_t> api_btn(opt<int16_t> n, int16_t p);
@@ -218,6 +324,12 @@ public:
             { "printh",   bind<&vm::api_printh>() },
             { "extcmd",   bind<&vm::api_extcmd>() },
 
+            { "count", bind<&vm::api_count>() },
+            { "add",   bind<&vm::api_add>() },
+            { "del",   bind<&vm::api_del>() },
+            { "deli",  bind<&vm::api_deli>() },
+            { "all",   bind<&vm::api_all>() },
+
             { "_update_buttons", bind<&vm::api_update_buttons>() },
             { "btn",  bind<&vm::api_btn>() },
             { "btnp", bind<&vm::api_btnp>() },
@@ -274,27 +386,65 @@ private:
 
     void hline(int16_t x1, int16_t x2, int16_t y, uint32_t color_bits);
     void vline(int16_t x, int16_t y1, int16_t y2, uint32_t color_bits);
+    void glyph(uint8_t const *rows, int16_t w, int16_t h,
+               int16_t x, int16_t y, uint32_t color_bits);
+
+    // Keep the screen shadow and the sprite cache in sync with accesses to
+    // memory [addr, addr + size) that do not go through them: flush the
+    // screen before reading or writing, then update them after writing.
+    void flush_screen(int addr, int size);
+    void memory_written(int addr, int size);
 
     void getaudio(int channel, void *buffer, int bytes);
     void update_registers();
     void update_prng();
     void set_music_pattern(int pattern);
 
+    void push_perms(bool persist);
+    void collect_garbage(float budget);
+
 public:
     // TODO: try to get rid of this
     struct lua_State *m_sandbox_lua;
 
+    profiler *get_profiler() const { return m_profiler.get(); }
+
 private:
+    // PICO-8 carts may use up to 2 MiB of Lua memory
+    static size_t constexpr lua_memory_limit = 2 * 1024 * 1024;
+
+    // Do not start a GC cycle before the heap has grown by this much
+    static size_t constexpr gc_min_growth = 256 * 1024;
+
+    heap m_heap;
+    size_t m_heap_base = 0;
+    size_t m_gc_threshold = 0;
+    bool m_gc_pending = false;
+    float m_gc_time = 0.f;
     struct lua_State *m_lua;
-    cart m_cart;
+    std::shared_ptr<cart> m_cart = std::make_shared<cart>();
+    int m_perms = LUA_NOREF, m_unperms = LUA_NOREF;
     memory m_ram;
+    gfx_cache m_gfx_cache;
+    screen_shadow m_screen;
+    bool m_screen_stale = false;
     state m_state;
+    synth m_synth;
 
     // Files
     std::string m_cartdata;
 
     lol::timer m_timer;
-    int m_instructions = 0;
+
+    // CPU usage since the last call to step()
+    cpu_cost m_cost;
+    float m_cpu_usage = 0.f;
+
+    // CPU preemption settings
+    int64_t m_cpu_budget = 2 * cpu_cost::cycles_per_frame;
+    int m_hook_period = 1000;
+
+    std::unique_ptr<profiler> m_profiler;
 };
 
 } // namespace z8::pico8
@@ -14,7 +14,6 @@
 #   include "config.h"
 #endif
 
-#include <lol/math>   // lol::rand
 #include <lol/vector> // lol::u8vec3
 #include <lol/msg>    // lol::msg
 
@@ -261,8 +260,12 @@ void vm::api_print(int x, int y, std::string str, int c)
 
 double vm::api_rnd(std::optional<double> x)
 {
-    return x.has_value() ? std::floor(lol::rand(x.value()))
-                         : lol::rand(1.0);
+    // Use the per-VM generator rather than the global lol::rand(). Scale
+    // a [0,1) value instead of building a [0,x) distribution, which would
+    // be undefined for rnd(0) and rnd(-n).
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    double ret = dist(m_rng) * x.value_or(1.0);
+    return x.has_value() ? std::floor(ret) : ret;
 }
 
 double vm::api_mid(double x, double y, double z)
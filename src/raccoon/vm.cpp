@@ -49,11 +49,11 @@ vm::~vm()
 {
 }
 
-void vm::load(std::string const &file)
+bool vm::load(std::string const &file)
 {
     std::string s;
     if (!lol::file::read(lol::sys::get_data_path(file), s))
-        return;
+        return false;
 
     lol::msg::debug("loaded file %s\n", file.c_str());
 
@@ -62,7 +62,7 @@ void vm::load(std::string const &file)
     {
         dump_error(m_ctx);
         JS_FreeValue(m_ctx, bin);
-        return;
+        return false;
     }
 
     m_name = get_property_str(m_ctx, bin, "name");
@@ -132,6 +132,8 @@ void vm::load(std::string const &file)
         }
         JS_FreeValue(m_ctx, rom);
     }
+
+    return true;
 }
 
 void vm::run()
@@ -13,6 +13,7 @@
 #pragma once
 
 #include <optional>   // std::optional
+#include <random>     // std::mt19937
 #include <lol/vector> // lol::ivec2
 
 #include "zepto8.h"
@@ -30,7 +31,7 @@ public:
     vm();
     virtual ~vm();
 
-    virtual void load(std::string const &file);
+    virtual bool load(std::string const &file);
     virtual void run();
     virtual bool step(float seconds);
 
@@ -141,6 +142,8 @@ private:
 
     memory m_rom;
     memory m_ram;
+
+    std::mt19937 m_rng { std::random_device()() };
 };
 
 }
@@ -16,7 +16,6 @@
 
 #include "synth.h"
 
-#include <lol/noise> // lol::perlin_noise
 #include <cmath>     // std::fabs, std::fmod
 
 namespace z8
@@ -61,9 +60,8 @@ float synth::waveform(int instrument, float advance)
             //
             // This may help us create a correct filter:
             // http://www.firstpr.com.au/dsp/pink-noise/
-            static lol::perlin_noise<1> noise;
             for (float m = 1.75f, d = 1.f; m <= 128; m *= 2.25f, d *= 0.75f)
-                ret += d * noise.eval(lol::vec_t<float, 1>(m * advance));
+                ret += d * m_noise.eval(lol::vec_t<float, 1>(m * advance));
             return ret * 0.4f;
         }
         case INST_PHASER:
@@ -12,6 +12,8 @@
 
 #pragma once
 
+#include <lol/noise> // lol::perlin_noise
+
 namespace z8
 {
 
@@ -34,7 +36,12 @@ public:
         INST_PHASER     = 7,
     };
 
-    static float waveform(int instrument, float advance);
+    float waveform(int instrument, float advance);
+
+private:
+    // Each generator owns its noise source so that VMs running on
+    // different threads do not share any state.
+    lol::perlin_noise<1> m_noise;
 };
 
 } // namespace z8
@@ -40,6 +40,7 @@ struct telnet
 {
     std::vector<uint8_t> m_screen;
     lol::ivec2 m_term_size = lol::ivec2(128, 64);
+    std::string m_seq;
 
     void run(std::string const &cart)
     {
@@ -128,8 +129,6 @@ struct telnet
     int get_key()
     {
 #if HAVE_UNISTD_H
-        static std::string seq;
-
         fd_set fds;
         FD_ZERO(&fds);
         FD_SET(STDIN_FILENO, &fds);
@@ -146,35 +145,35 @@ struct telnet
         if (read(STDIN_FILENO, &ch, 1) <= 0)
             exit(EXIT_SUCCESS);
 
-        if (ch != '\x1b' && ch != '\xff' && seq.length() == 0)
+        if (ch != '\x1b' && ch != '\xff' && m_seq.length() == 0)
             return ch;
 
-        seq += ch;
+        m_seq += ch;
 
         // TELNET commands
-        if (seq[0] == '\xff') // telnet commands
+        if (m_seq[0] == '\xff') // telnet commands
         {
-            if (seq[1] >= '\xfb' && seq[1] <= '\xfe')
+            if (m_seq[1] >= '\xfb' && m_seq[1] <= '\xfe')
             {
-                if (seq[2] == 0)
+                if (m_seq[2] == 0)
                     return -1; // wait for more data
                 goto reset;
             }
-            else if (seq[1] == '\xfa') // subnegociation
+            else if (m_seq[1] == '\xfa') // subnegociation
             {
-                if (seq[2] == 0)
+                if (m_seq[2] == 0)
                     return -1; // wait for more data
-                if (seq[2] != '\x1f')
+                if (m_seq[2] != '\x1f')
                     goto reset; // can’t happen
-                if (seq.length() < 9)
+                if (m_seq.length() < 9)
                     return -1; // wait for more data
-                m_term_size.x = (uint8_t)seq[3] * 256 + (uint8_t)seq[4];
-                m_term_size.y = (uint8_t)seq[5] * 256 + (uint8_t)seq[6];
+                m_term_size.x = (uint8_t)m_seq[3] * 256 + (uint8_t)m_seq[4];
+                m_term_size.y = (uint8_t)m_seq[5] * 256 + (uint8_t)m_seq[6];
                 printf("\x1b[2J"); // clear screen
                 m_screen.clear();
                 goto reset;
             }
-            else if (seq.length() >= 3)
+            else if (m_seq.length() >= 3)
             {
                 goto reset;
             }
@@ -183,19 +182,19 @@ struct telnet
         }
 
         // Escape sequences
-        if (seq[0] == '\x1b')
+        if (m_seq[0] == '\x1b')
         {
-            if (seq[1] == '\x5b')
+            if (m_seq[1] == '\x5b')
             {
-                if (seq[2] == 0)
+                if (m_seq[2] == 0)
                     return -1; // wait for more data
-                int ret = 0x100 + seq[2];
-                seq = "";
+                int ret = 0x100 + m_seq[2];
+                m_seq = "";
                 return ret;
             }
-            else if (seq[1] == '\x1b')
+            else if (m_seq[1] == '\x1b')
             {
-                seq = "";
+                m_seq = "";
                 return '\x1b';
             }
 
@@ -203,7 +202,7 @@ struct telnet
         }
 
 reset:
-        seq = "";
+        m_seq = "";
 #endif
         return -1;
     }
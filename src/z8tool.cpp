@@ -33,6 +33,8 @@
 #include "pico8/pico8.h"
 #include "raccoon/vm.h"
 #include "telnet.h"
+#include "batch.h"
+#include "bench.h"
 #include "splore.h"
 #include "dither.h"
 #include "minify.h"
@@ -49,6 +51,8 @@ enum class mode
     printast,
     convert,
     run, headless, telnet,
+    batch,
+    bench,
 
     dither,
     compress,
@@ -176,8 +180,13 @@ int main(int argc, char **argv)
     lol::sys::init(argc, argv);
 
     mode run_mode = mode::none, override_mode = mode::none;
-    std::string in, out, data, palette;
+    std::string in, out, data, palette, profile;
+    std::vector<std::string> carts;
     size_t raw = 0, skip = 0;
+    int frames = 600, jobs = 0, hook_period = 1000;
+    float cpu_budget = 2.f, min_mpixels = 0.f, min_speedup = 0.f;
+    std::string golden;
+    bool update = false;
     bool hicolor = false;
     bool error_diffusion = false;
 
@@ -216,8 +225,37 @@ int main(int argc, char **argv)
 #endif
     run->add_flag_function("--headless", [&](int64_t) { override_mode = mode::headless; },
                             "Run without any output");
+    run->add_option("--profile", profile, "Write collapsed Lua stacks to this file")
+       ->type_name("<file>");
+    run->add_option("--cpu-budget", cpu_budget, "Interrupt frames using more CPU than this")
+       ->type_name("<frames>");
+    run->add_option("--hook-period", hook_period, "Check the CPU budget every <n> Lua instructions")
+       ->type_name("<n>");
     run->add_option("cart", in, "Cartridge to load")->required();;
 
+    // Run many carts in parallel, without any output
+    auto batch = app.add_subcommand("batch", "Run many carts headless on all cores")
+                     ->callback([&]() { run_mode = mode::batch; });
+    batch->add_option("-f,--frames", frames, "Number of frames to run per cart")
+         ->type_name("<int>");
+    batch->add_option("-j,--jobs", jobs, "Number of worker threads (default: all cores)")
+         ->type_name("<int>");
+    batch->add_option("carts", carts, "Cartridges or directories to load")->required();
+
+    // Microbenchmarks
+    auto bench = app.add_subcommand("bench", "Benchmark API calls, graphics primitives, VM snapshots and clones")
+                     ->callback([&]() { run_mode = mode::bench; });
+    bench->add_option("-f,--frames", frames, "Number of frames to run before measuring")
+         ->type_name("<int>");
+    bench->add_option("--gfx", golden, "Check graphics sweeps against the screen hashes in this file")
+         ->type_name("<file>");
+    bench->add_flag("--update", update, "Store new or changed screen hashes in the --gfx file");
+    bench->add_option("--min-mpixels", min_mpixels, "Fail if a graphics sweep draws fewer pixels per second")
+         ->type_name("<float>");
+    bench->add_option("--min-speedup", min_speedup, "Fail if a graphics sweep is not this many times faster than pset()")
+         ->type_name("<float>");
+    bench->add_option("cart", in, "Cartridge to load for snapshot benchmarks");
+
 #if 0
     // TODO: splore
     auto splore = app.add_subcommand("splore", "XXXXX")
@@ -325,16 +363,28 @@ int main(int argc, char **argv)
     case mode::headless:
     case mode::run: {
         std::unique_ptr<z8::vm_base> vm;
+        z8::pico8::vm *pico8 = nullptr;
         if (lol::ends_with(in, ".rcn.json"))
             vm.reset((z8::vm_base *)new z8::raccoon::vm());
         else
-            vm.reset((z8::vm_base *)new z8::pico8::vm());
+            vm.reset((z8::vm_base *)(pico8 = new z8::pico8::vm()));
+
+        if (profile.size() && pico8)
+            pico8->enable_profiler();
+        if (pico8)
+            pico8->set_cpu_budget(cpu_budget, hook_period);
+
         vm->load(in);
         vm->run();
-        for (bool running = true; running; )
+        for (int frame = 0, running = true; running; ++frame)
         {
             lol::timer t;
             running = vm->step(1.f / 60.f);
+
+            // Save the profile regularly, since we may get interrupted
+            if (profile.size() && pico8 && (!running || frame % 60 == 59))
+                pico8->save_profile(profile);
+
             if (run_mode != mode::headless)
             {
                 vm->print_ansi(lol::ivec2(128, 64), nullptr);
@@ -344,6 +394,28 @@ int main(int argc, char **argv)
         break;
     }
 
+    case mode::batch: {
+        z8::batch batch;
+        for (auto const &cart : carts)
+            batch.add(cart);
+        if (!batch.run(frames, jobs))
+            return EXIT_FAILURE;
+        break;
+    }
+
+    case mode::bench:
+        if (golden.size())
+        {
+            if (!z8::bench::gfx(golden, update, min_mpixels, min_speedup))
+                return EXIT_FAILURE;
+            break;
+        }
+        if (!z8::bench::dispatch())
+            return EXIT_FAILURE;
+        if (in.size() && !z8::bench::clone(in, frames))
+            return EXIT_FAILURE;
+        break;
+
     case mode::dither:
         z8::dither(in, out, palette, hicolor, error_diffusion);
         break;
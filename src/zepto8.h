@@ -80,7 +80,7 @@ public:
     vm_base() = default;
     virtual ~vm_base() = default;
 
-    virtual void load(std::string const &name) = 0;
+    virtual bool load(std::string const &name) = 0;
     virtual void run() = 0;
     virtual bool step(float seconds) = 0;
 
@@ -110,8 +110,18 @@ public:
     virtual std::tuple<uint8_t *, size_t> ram() = 0;
     virtual std::tuple<uint8_t *, size_t> rom() = 0;
 
+    // Time spent in the garbage collector during the last step()
+    virtual float get_gc_time() const { return 0.f; }
+
+    // Emulated CPU used during the last step() (1.0 == 100% at 30fps)
+    virtual float get_cpu_usage() const { return 0.f; }
+
+    // Return an independent copy of the VM in its current state, or
+    // nullptr if the VM does not support it
+    virtual std::unique_ptr<vm_base> clone() { return nullptr; }
+
 protected:
-    std::unique_ptr<pico8::bios> m_bios; // TODO: get rid of this
+    pico8::bios const *m_bios = nullptr; // TODO: get rid of this
 };
 
 enum
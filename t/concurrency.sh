@@ -0,0 +1,19 @@
+#!/bin/sh
+
+# Step several VMs at the same time, each on its own thread, to check that
+# libzepto8 has no process-global mutable state. This is mostly useful with
+# a ThreadSanitizer build (./configure --enable-tsan), which will report any
+# data race and make the test fail.
+
+set -e
+
+z8tool="${abs_top_builddir:-..}/z8tool"
+srcdir="${abs_top_srcdir:-..}"
+
+TSAN_OPTIONS="halt_on_error=1 ${TSAN_OPTIONS}"
+export TSAN_OPTIONS
+
+# Pass the cart list twice so that identical carts also run side by side
+"${z8tool}" batch --jobs 4 --frames 120 \
+    "${srcdir}/carts" "${srcdir}/t" \
+    "${srcdir}/carts" "${srcdir}/t"
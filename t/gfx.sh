@@ -0,0 +1,21 @@
+#!/bin/sh
+
+# Draw seeded random sweeps of each graphics primitive and compare the
+# resulting screens with the hashes in gfx.golden, so that rasterizer
+# changes cannot silently alter pixel output. Timings are too noisy on
+# loaded or instrumented builds to be checked by default: set
+# Z8_MIN_SPEEDUP (e.g. 4) to require each primitive to draw that many
+# times more pixels per second than pset(), and Z8_MIN_MPIXELS to also
+# enforce an absolute floor on a known host.
+#
+# After an intentional change in output, refresh the hashes with:
+#   z8tool bench --gfx t/gfx.golden --update
+
+set -e
+
+z8tool="${abs_top_builddir:-..}/z8tool"
+srcdir="${abs_top_srcdir:-..}"
+
+"${z8tool}" bench --gfx "${srcdir}/t/gfx.golden" \
+    --min-speedup "${Z8_MIN_SPEEDUP:-0}" \
+    --min-mpixels "${Z8_MIN_MPIXELS:-0}"
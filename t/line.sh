@@ -0,0 +1,18 @@
+#!/bin/sh
+
+# Run the line() conformance cart, which compares line() against a pset()
+# reference for fixed and random endpoints, and fail unless its summary
+# reports that every test passed.
+
+set -e
+
+z8tool="${abs_top_builddir:-..}/z8tool"
+srcdir="${abs_top_srcdir:-..}"
+
+out="$("${z8tool}" run --headless "${srcdir}/t/line.p8")"
+echo "${out}"
+
+case "${out}" in
+    *" passed, 0 failed."*) ;;
+    *) exit 1 ;;
+esac